@@ -0,0 +1,48 @@
+// 64 button box read from an 8x8 button matrix.
+//
+// Wire one side of every button to a row pin and the other side to a
+// column pin, with a diode per button towards the row if several buttons
+// may be held at once. Button n of the joystick is row n / 8, column n % 8.
+//
+// Once a second the sketch prints the scan rate over Serial. A press
+// reaches the host BUTTON_MATRIX_DEBOUNCE_SCANS scans after it settles,
+// so the report latency is that many scan periods.
+//------------------------------------------------------------
+#include <Joystick.h>
+#include <ButtonMatrix.h>
+
+const uint8_t rowPins[8] = {2, 3, 4, 5, 6, 7, 8, 9};
+const uint8_t columnPins[8] = {10, 16, 14, 15, A0, A1, A2, A3};
+
+Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID, 
+  JOYSTICK_TYPE_GAMEPAD, 64, 0,
+  false, false, false, //X,Y,Z
+  false, false, false,//Rx,Ry,Rz
+  false, false, false, false, false,
+  false);//no force feedback
+
+ButtonMatrix matrix(rowPins, 8, columnPins, 8);
+
+unsigned long scans = 0;
+unsigned long lastPrint = 0;
+
+void setup(){
+  Serial.begin(115200);
+  matrix.begin();
+  Joystick.begin();
+}
+
+void loop(){
+  matrix.scan(Joystick);
+  scans++;
+
+  unsigned long now = millis();
+  if (now - lastPrint >= 1000) {
+    Serial.print("scans/s: ");
+    Serial.print(scans * 1000.0 / (now - lastPrint));
+    Serial.print(" latency us: ");
+    Serial.println((now - lastPrint) * 1000.0 * BUTTON_MATRIX_DEBOUNCE_SCANS / scans);
+    scans = 0;
+    lastPrint = now;
+  }
+}
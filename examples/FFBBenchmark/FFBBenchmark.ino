@@ -0,0 +1,331 @@
+// Times the force engine and the report builders on the board and prints
+// one CSV line per benchmark over Serial:
+//   name,calls,us_per_call
+// With BENCH_CYCLES the times are CPU cycles counted by Timer1 instead,
+// and extras/ffbbenchsimavr.sh runs the sketch in simavr for exact counts.
+// force_<type>_<n>   getForce() with n playing effects of one type
+// force_none         getForce() with no effect, subtract it from the
+//                    force_<type>_1 lines to get one effect's calculator
+// force_mix_<n>      getForce() with the first n effects of a typical wheel
+//                    mix: spring, damper, friction, constant, sine, ramp
+// envelope_<type>    one effect inside its attack and fade (ApplyEnvelope)
+// send_state_min/max sendState() of a 1 axis and of a full joystick
+// parse_<report>     UppackUsbData() of one PID output report
+// Condition effects see new metrics on every call, as with a moving wheel.
+// Save the output of a known good build as the baseline and compare later
+// runs with extras/ffbbenchcompare.py, which flags what got slower.
+// extras/host/ffbbench.sh builds and runs the sketch on a PC, with the
+// times in nanoseconds.
+//------------------------------------------------------------
+#include "Joystick.h"
+
+// Calls timed per benchmark line, at most 32000 so the test effects fit
+// their 16 bit durations
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 100
+#endif
+// Set to 1 to time in CPU cycles with Timer1 instead of micros(), AVR only.
+// The millis() interrupt is stopped then, so it does not add to the counts.
+#ifndef BENCH_CYCLES
+#define BENCH_CYCLES 0
+#endif
+// Port the results are printed on, simavr shows Serial1 of a 32u4
+#ifndef BENCH_SERIAL
+#define BENCH_SERIAL Serial
+#endif
+// Timer read without BENCH_CYCLES and the unit it counts in
+#ifndef BENCH_TIMER
+#define BENCH_TIMER micros
+#define BENCH_UNIT "us"
+#endif
+// What the sketch does when it is done, the host build exits
+#ifndef BENCH_END
+#define BENCH_END while (true)
+#endif
+
+#if BENCH_CYCLES
+#include <avr/sleep.h>
+
+volatile uint16_t timer1Overflows = 0;
+
+ISR(TIMER1_OVF_vect){
+  timer1Overflows++;
+}
+
+uint32_t benchTime(){
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t low = TCNT1;
+  uint16_t high = timer1Overflows;
+  // Overflowed since the interrupts were turned off
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000)
+    high++;
+  SREG = oldSREG;
+  return ((uint32_t)high << 16) | low;
+}
+#else
+uint32_t benchTime(){
+  return BENCH_TIMER();
+}
+#endif
+
+// Swallows the input reports, so no host is needed
+class NullTransport : public DynamicHIDTransport {
+public:
+  int send(const void* data, int len) {
+    return len;
+  }
+  int sendSpace() {
+    return USB_EP_SIZE;
+  }
+  int available() {
+    return 0;
+  }
+  int recv(void* data, int len) {
+    return -1;
+  }
+};
+
+NullTransport nullTransport;
+
+// Everything on
+Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID,
+  JOYSTICK_TYPE_JOYSTICK, 32, 2,
+  true, true, true, //X,Y,Z
+  true, true, true,//Rx,Ry,Rz
+  true, true, true, true, true);
+
+// X axis only, no force feedback
+Joystick_ MinJoystick(0x0F,
+  JOYSTICK_TYPE_JOYSTICK, 0, 0,
+  true, false, false, //X,Y,Z
+  false, false, false,//Rx,Ry,Rz
+  false, false, false, false, false, false);
+
+Gains mygains[MAX_FFB_AXIS_COUNT];
+EffectParams myeffectparams[MAX_FFB_AXIS_COUNT];
+int32_t forces[MAX_FFB_AXIS_COUNT] = {0};
+PIDReportHandler* pid;
+
+unsigned long virtualTime = 0;
+
+unsigned long virtualClock(){
+  return virtualTime;
+}
+
+const char* const effectNames[] = {
+  "constant", "ramp", "square", "sine", "triangle", "sawtooth_down",
+  "sawtooth_up", "spring", "damper", "inertia", "friction"
+};
+
+void printResult(const char* name, const char* suffix, int n, uint32_t elapsed){
+  BENCH_SERIAL.print(name);
+  if (suffix) {
+    BENCH_SERIAL.print('_');
+    BENCH_SERIAL.print(suffix);
+  }
+  if (n > 0) {
+    BENCH_SERIAL.print('_');
+    BENCH_SERIAL.print(n);
+  }
+  BENCH_SERIAL.print(',');
+  BENCH_SERIAL.print(BENCH_CALLS);
+  BENCH_SERIAL.print(',');
+  BENCH_SERIAL.println(elapsed / (float)BENCH_CALLS);
+}
+
+// Creates and starts an effect of the type on X and Y, returns its id or 0
+uint8_t addEffect(uint8_t type, uint16_t duration){
+  USB_FFBReport_CreateNewEffect_Feature_Data_t create = {5, type, 0};
+  pid->CreateNewEffect(&create);
+  uint8_t id = pid->getPIDBlockLoad()[1];
+  if (id == 0)
+    return 0;
+
+  USB_FFBReport_SetEffect_Output_Data_t effect;
+  memset(&effect, 0, sizeof(effect));
+  effect.reportId = 1;
+  effect.effectBlockIndex = id;
+  effect.effectType = type;
+  effect.duration = duration;
+  effect.gain = 255;
+  effect.enableAxis = X_AXIS_ENABLE | Y_AXIS_ENABLE;
+  effect.direction[0] = 32;
+  effect.direction[1] = 32;
+  pid->UppackUsbData((uint8_t*)&effect, sizeof(effect));
+
+  if (type >= USB_EFFECT_SPRING) {
+    for (uint8_t axis = 0; axis < 2; axis++) {
+      USB_FFBReport_SetCondition_Output_Data_t condition = {3, id, axis, 0, 5000, 5000, 10000, 10000, 0};
+      pid->UppackUsbData((uint8_t*)&condition, sizeof(condition));
+    }
+  } else if (type >= USB_EFFECT_SQUARE) {
+    USB_FFBReport_SetPeriodic_Output_Data_t periodic = {4, id, 5000, 0, 0, 50};
+    pid->UppackUsbData((uint8_t*)&periodic, sizeof(periodic));
+  } else if (type == USB_EFFECT_RAMP) {
+    USB_FFBReport_SetRampForce_Output_Data_t ramp = {6, id, -5000, 5000};
+    pid->UppackUsbData((uint8_t*)&ramp, sizeof(ramp));
+  } else {
+    USB_FFBReport_SetConstantForce_Output_Data_t constant = {5, id, 5000};
+    pid->UppackUsbData((uint8_t*)&constant, sizeof(constant));
+  }
+
+  USB_FFBReport_EffectOperation_Output_Data_t start = {10, id, 1, 0};
+  pid->UppackUsbData((uint8_t*)&start, sizeof(start));
+  return id;
+}
+
+// Runs getForce() BENCH_CALLS times, one virtual millisecond apart
+uint32_t timeForces(){
+  uint32_t elapsed = 0;
+  for (int call = 0; call < BENCH_CALLS; call++) {
+    virtualTime++;
+    int32_t metric = (call & 1) ? call : -call;
+    for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++) {
+      myeffectparams[axis].springPosition = metric;
+      myeffectparams[axis].damperVelocity = metric;
+      myeffectparams[axis].inertiaAcceleration = metric;
+      myeffectparams[axis].frictionPositionChange = metric;
+    }
+    uint32_t start = benchTime();
+    Joystick.getForce(forces);
+    elapsed += benchTime() - start;
+  }
+  return elapsed;
+}
+
+void benchForces(){
+  pid->FreeAllEffects();
+  printResult("force_none", NULL, 0, timeForces());
+  for (uint8_t type = USB_EFFECT_CONSTANT; type <= USB_EFFECT_FRICTION; type++) {
+    pid->FreeAllEffects();
+    for (uint8_t n = 1; n <= MAX_EFFECTS; n++) {
+      if (addEffect(type, USB_DURATION_INFINITE) == 0)
+        break;
+      printResult("force", effectNames[type - 1], n, timeForces());
+    }
+  }
+}
+
+void benchMix(){
+  const uint8_t types[] = {USB_EFFECT_SPRING, USB_EFFECT_DAMPER, USB_EFFECT_FRICTION,
+    USB_EFFECT_CONSTANT, USB_EFFECT_SINE, USB_EFFECT_RAMP};
+  pid->FreeAllEffects();
+  for (uint8_t n = 1; n <= sizeof(types); n++) {
+    addEffect(types[n - 1], USB_DURATION_INFINITE);
+    printResult("force_mix", NULL, n, timeForces());
+  }
+}
+
+void benchEnvelopes(){
+  const uint8_t types[] = {USB_EFFECT_CONSTANT, USB_EFFECT_RAMP, USB_EFFECT_SINE};
+  for (uint8_t i = 0; i < sizeof(types); i++) {
+    pid->FreeAllEffects();
+    // Attack over the first half of the calls, fade over the second
+    uint8_t id = addEffect(types[i], BENCH_CALLS + 10);
+    USB_FFBReport_SetEnvelope_Output_Data_t envelope = {2, id, 0, 0, BENCH_CALLS / 2 + 5, BENCH_CALLS / 2 + 5};
+    pid->UppackUsbData((uint8_t*)&envelope, sizeof(envelope));
+    printResult("envelope", effectNames[types[i] - 1], 0, timeForces());
+  }
+}
+
+void benchSendState(Joystick_& joystick, const char* name){
+  uint32_t elapsed = 0;
+  for (int call = 0; call < BENCH_CALLS; call++) {
+    joystick.setXAxis(call);
+    joystick.setButton(call % 32, call & 1);
+    uint32_t start = benchTime();
+    joystick.sendState();
+    elapsed += benchTime() - start;
+  }
+  printResult(name, NULL, 0, elapsed);
+}
+
+void timeReport(const char* name, void* report, uint16_t len){
+  uint32_t start = benchTime();
+  for (int call = 0; call < BENCH_CALLS; call++)
+    pid->UppackUsbData((uint8_t*)report, len);
+  printResult("parse", name, 0, benchTime() - start);
+}
+
+void benchParse(){
+  pid->FreeAllEffects();
+  uint8_t id = addEffect(USB_EFFECT_SINE, USB_DURATION_INFINITE);
+
+  USB_FFBReport_SetEffect_Output_Data_t effect;
+  memset(&effect, 0, sizeof(effect));
+  effect.reportId = 1;
+  effect.effectBlockIndex = id;
+  effect.effectType = USB_EFFECT_SINE;
+  effect.duration = USB_DURATION_INFINITE;
+  effect.gain = 255;
+  effect.enableAxis = X_AXIS_ENABLE | Y_AXIS_ENABLE;
+  timeReport("set_effect", &effect, sizeof(effect));
+
+  USB_FFBReport_SetEnvelope_Output_Data_t envelope = {2, id, 0, 0, 0, 0};
+  timeReport("set_envelope", &envelope, sizeof(envelope));
+  USB_FFBReport_SetCondition_Output_Data_t condition = {3, id, 0, 0, 5000, 5000, 10000, 10000, 0};
+  timeReport("set_condition", &condition, sizeof(condition));
+  USB_FFBReport_SetPeriodic_Output_Data_t periodic = {4, id, 5000, 0, 0, 50};
+  timeReport("set_periodic", &periodic, sizeof(periodic));
+  USB_FFBReport_SetConstantForce_Output_Data_t constant = {5, id, 5000};
+  timeReport("set_constant_force", &constant, sizeof(constant));
+  USB_FFBReport_SetRampForce_Output_Data_t ramp = {6, id, -5000, 5000};
+  timeReport("set_ramp_force", &ramp, sizeof(ramp));
+  USB_FFBReport_EffectOperation_Output_Data_t operation = {10, id, 1, 0};
+  timeReport("effect_operation", &operation, sizeof(operation));
+  USB_FFBReport_DeviceControl_Output_Data_t control = {12, 6};//Continue
+  timeReport("device_control", &control, sizeof(control));
+  USB_FFBReport_DeviceGain_Output_Data_t gain = {13, 255};
+  timeReport("device_gain", &gain, sizeof(gain));
+}
+
+void setup(){
+  BENCH_SERIAL.begin(115200);
+  while (!BENCH_SERIAL);
+  for (int i = 0; i < MAX_FFB_AXIS_COUNT; i++) {
+    mygains[i].totalGain = 100;
+    myeffectparams[i].springMaxPosition = 1023;
+    myeffectparams[i].damperMaxVelocity = 1023;
+    myeffectparams[i].inertiaMaxAcceleration = 1023;
+    myeffectparams[i].frictionMaxPositionChange = 1023;
+  }
+  Joystick.setGains(mygains);
+  Joystick.setEffectParams(myeffectparams);
+  Joystick.setClock(virtualClock);
+  DynamicHID().setTransport(&nullTransport);
+  Joystick.begin(false);
+  MinJoystick.begin(false);
+  uint8_t pidReportId;
+  pid = DynamicHID().findPIDReportHandler(JOYSTICK_DEFAULT_REPORT_ID, &pidReportId);
+#if BENCH_CYCLES
+  TIMSK0 &= ~_BV(TOIE0);
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);//clk/1
+  TIMSK1 = _BV(TOIE1);
+#endif
+}
+
+void loop(){
+#if BENCH_CYCLES
+  BENCH_SERIAL.println("# name,calls,cycles_per_call");
+#else
+  BENCH_SERIAL.println("# name,calls," BENCH_UNIT "_per_call");
+#endif
+  benchForces();
+  benchMix();
+  benchEnvelopes();
+  benchSendState(MinJoystick, "send_state_min");
+  benchSendState(Joystick, "send_state_max");
+  benchParse();
+  BENCH_SERIAL.println("# done");
+#if BENCH_CYCLES
+  // simavr exits when the CPU sleeps with the interrupts off
+  BENCH_SERIAL.flush();
+  cli();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sleep_cpu();
+#endif
+  BENCH_END;
+}
@@ -0,0 +1,140 @@
+// Runs the whole report path on the board, with no host attached: a
+// loopback transport stands in for the USB endpoints, and loop() plays
+// the host. Every round trip queues a PID Set Constant Force report, lets
+// getForce() parse it and compute the force, sends the force back as the
+// X axis in the joystick input report, and waits for that report to come
+// out of the transport. Round trip latency (min/mean/max) and throughput
+// are printed over Serial once per second.
+//------------------------------------------------------------
+#include "Joystick.h"
+
+// Holds at most one OUT report and records the IN reports
+class LoopbackTransport : public DynamicHIDTransport {
+public:
+  uint8_t out[USB_EP_SIZE];
+  int outLength = 0;
+  uint8_t lastIn[USB_EP_SIZE];
+  int lastInLength = 0;
+  uint32_t inReports = 0;
+  uint32_t inBytes = 0;
+
+  int send(const void* data, int len) {
+    if (len > (int)sizeof(lastIn))
+      return -1;
+    memcpy(lastIn, data, len);
+    lastInLength = len;
+    inReports++;
+    inBytes += len;
+    return len;
+  }
+  int sendSpace() {
+    return sizeof(lastIn);
+  }
+  int available() {
+    return outLength;
+  }
+  int recv(void* data, int len) {
+    if (outLength == 0)
+      return -1;
+    len = min(len, outLength);
+    memcpy(data, out, len);
+    outLength = 0;
+    return len;
+  }
+  // Host side: queue one OUT report
+  void write(const uint8_t* data, int len) {
+    memcpy(out, data, len);
+    outLength = len;
+  }
+};
+
+LoopbackTransport loopback;
+
+Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID,
+  JOYSTICK_TYPE_JOYSTICK, 0, 0,
+  true, true, false, //X,Y,Z
+  false, false, false,//Rx,Ry,Rz
+  false, false, false, false, false);
+
+Gains mygains[MAX_FFB_AXIS_COUNT];
+EffectParams myeffectparams[MAX_FFB_AXIS_COUNT];
+int32_t forces[MAX_FFB_AXIS_COUNT] = {0};
+
+uint32_t roundTrips = 0;
+uint32_t outBytes = 0;
+unsigned long latencyMin = 0xFFFFFFFF;
+unsigned long latencyMax = 0;
+unsigned long latencyTotal = 0;
+unsigned long windowStart = 0;
+
+// Host side: queues one report and runs the device until it is consumed
+void hostWrite(const uint8_t* report, int len) {
+  loopback.write(report, len);
+  outBytes += len;
+  while (loopback.available())
+    Joystick.getForce(forces);
+}
+
+void setup(){
+  Serial.begin(115200);
+  while (!Serial);
+  for (int i = 0; i < MAX_FFB_AXIS_COUNT; i++) {
+    mygains[i].totalGain = 100;
+  }
+  Joystick.setGains(mygains);
+  Joystick.setEffectParams(myeffectparams);
+  Joystick.setXAxisRange(-255, 255);
+  DynamicHID().setTransport(&loopback);
+  Joystick.begin();
+
+  // Create a constant force effect (block 1), infinite duration, along X (90 degrees), started
+  USB_FFBReport_CreateNewEffect_Feature_Data_t create = {5, USB_EFFECT_CONSTANT, 0};
+  uint8_t pidReportId;
+  DynamicHID().findPIDReportHandler(JOYSTICK_DEFAULT_REPORT_ID, &pidReportId)->CreateNewEffect(&create);
+  const uint8_t setEffect[18 + MAX_FFB_AXIS_COUNT] = {1, 1, USB_EFFECT_CONSTANT, 0xFF, 0x7F, 0, 0, 0, 0, 255, 0, X_AXIS_ENABLE, 64};
+  hostWrite(setEffect, sizeof(setEffect));
+  const uint8_t start[] = {10, 1, 1, 0};
+  hostWrite(start, sizeof(start));
+  windowStart = micros();
+}
+
+void loop(){
+  // Alternate the magnitude so every round trip changes the force
+  int16_t magnitude = (roundTrips & 1) ? 10000 : -10000;
+  uint8_t setConstant[] = {5, 1, (uint8_t)magnitude, (uint8_t)(magnitude >> 8)};
+
+  unsigned long start = micros();
+  hostWrite(setConstant, sizeof(setConstant));
+  Joystick.setXAxis(forces[0]);
+  unsigned long latency = micros() - start;
+  if (loopback.lastInLength == 0 || loopback.lastIn[0] != JOYSTICK_DEFAULT_REPORT_ID)
+    return;
+
+  roundTrips++;
+  latencyTotal += latency;
+  latencyMin = min(latencyMin, latency);
+  latencyMax = max(latencyMax, latency);
+
+  unsigned long elapsed = micros() - windowStart;
+  if (elapsed >= 1000000UL) {
+    Serial.print("round trips/s: ");
+    Serial.print(roundTrips * 1000000.0 / elapsed);
+    Serial.print(" latency us min/mean/max: ");
+    Serial.print(latencyMin);
+    Serial.print('/');
+    Serial.print(latencyTotal / roundTrips);
+    Serial.print('/');
+    Serial.print(latencyMax);
+    Serial.print(" out B/s: ");
+    Serial.print(outBytes * 1000000.0 / elapsed);
+    Serial.print(" in B/s: ");
+    Serial.println(loopback.inBytes * 1000000.0 / elapsed);
+    roundTrips = 0;
+    outBytes = 0;
+    loopback.inBytes = 0;
+    latencyMin = 0xFFFFFFFF;
+    latencyMax = 0;
+    latencyTotal = 0;
+    windowStart = micros();
+  }
+}
@@ -0,0 +1,119 @@
+// Replays a captured force feedback session (capture.h) through the
+// PID report handler under a virtual clock, one tick per millisecond,
+// and prints "time force0 force1 ..." for every tick over Serial.
+// Save the output as a golden trace and diff it after changing the
+// force engine. Set PRINT_FORCES to 0 to measure replay throughput.
+// extras/host/ffbreplay.sh runs the sketch on a PC and diffs the trace.
+//------------------------------------------------------------
+#include "Joystick.h"
+#include "capture.h"
+
+#ifndef PRINT_FORCES
+#define PRINT_FORCES 1
+#endif
+// Ticks to keep running after the last captured report
+#define REPLAY_TAIL_MS 500
+// What the sketch does when it is done, the host build exits
+#ifndef REPLAY_END
+#define REPLAY_END while (true)
+#endif
+
+Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID, 
+  JOYSTICK_TYPE_JOYSTICK, 0, 0,
+  true, true, false, //X,Y,Z
+  false, false, false,//Rx,Ry,Rz
+  false, false, false, false, false);
+
+Gains mygains[MAX_FFB_AXIS_COUNT];
+EffectParams myeffectparams[MAX_FFB_AXIS_COUNT];
+int32_t forces[MAX_FFB_AXIS_COUNT] = {0};
+
+unsigned long virtualTime = 0;
+
+unsigned long virtualClock(){
+  return virtualTime;
+}
+
+uint32_t readTime(uint16_t offset){
+  uint32_t time = 0;
+  for (int i = 3; i >= 0; i--)
+    time = (time << 8) | pgm_read_byte(&capture[offset + i]);
+  return time;
+}
+
+// Feeds every record captured up to the current tick, returns the number of reports
+uint16_t replayReports(uint16_t* offset){
+  uint8_t report[USB_EP_SIZE];
+  uint16_t reports = 0;
+  while (*offset < sizeof(capture) && readTime(*offset) <= virtualTime) {
+    uint8_t type = pgm_read_byte(&capture[*offset + 4]);
+    uint8_t len = pgm_read_byte(&capture[*offset + 5]);
+    uint16_t data = *offset + 6;
+    *offset += 6 + len;
+    if (len == 0 || len > sizeof(report))
+      continue;
+    memcpy_P(report, &capture[data], len);
+    uint8_t pidReportId;
+    PIDReportHandler* handler = DynamicHID().findPIDReportHandler(report[0], &pidReportId);
+    if (handler == NULL)
+      continue;
+    report[0] = pidReportId;
+    if (type == REPLAY_FEATURE && pidReportId == 5)//Create New Effect
+      handler->CreateNewEffect((USB_FFBReport_CreateNewEffect_Feature_Data_t*)report);
+    else if (type == REPLAY_OUTPUT)
+      handler->UppackUsbData(report, len);
+    reports++;
+  }
+  return reports;
+}
+
+void setup(){
+  Serial.begin(115200);
+  while (!Serial);
+  for (int i = 0; i < MAX_FFB_AXIS_COUNT; i++) {
+    mygains[i].totalGain = 100;
+    myeffectparams[i].springMaxPosition = 1023;
+    myeffectparams[i].springPosition = 0;
+  }
+  Joystick.setGains(mygains);
+  Joystick.setEffectParams(myeffectparams);
+  Joystick.setClock(virtualClock);
+  Joystick.begin();
+}
+
+void loop(){
+  uint16_t offset = 0;
+  uint32_t reports = 0;
+  uint32_t ticks = 0;
+  uint32_t endTime = REPLAY_TAIL_MS;
+  unsigned long start = micros();
+  for (virtualTime = 0; offset < sizeof(capture) || virtualTime <= endTime; virtualTime++) {
+    uint16_t fed = replayReports(&offset);
+    if (fed) {
+      reports += fed;
+      endTime = virtualTime + REPLAY_TAIL_MS;
+    }
+    Joystick.getForce(forces);
+    ticks++;
+#if PRINT_FORCES
+    Serial.print(virtualTime);
+    for (int i = 0; i < MAX_FFB_AXIS_COUNT; i++) {
+      Serial.print(' ');
+      Serial.print(forces[i]);
+    }
+    Serial.println();
+#endif
+  }
+  unsigned long elapsed = micros() - start;
+  Serial.print("# reports: ");
+  Serial.print(reports);
+  Serial.print(" ticks: ");
+  Serial.print(ticks);
+  Serial.print(" us: ");
+  Serial.println(elapsed);
+  Serial.print("# reports/s: ");
+  Serial.print(reports * 1000000.0 / elapsed);
+  Serial.print(" ticks/s: ");
+  Serial.println(ticks * 1000000.0 / elapsed);
+  REPLAY_END;
+}
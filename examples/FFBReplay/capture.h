@@ -0,0 +1,59 @@
+// Captured PID traffic for the FFBReplay example.
+//
+// Each record is: time in ms (4 bytes, little endian), record type,
+// report length, then the report bytes as seen on the wire (report ID first).
+// Record type 0 is an output report, 1 is a Create New Effect feature report.
+// Block Load requests are not recorded, they only read back the effect
+// that Create New Effect allocated.
+//
+// extras/usbmon2replay.py turns a Linux usbmon text capture into this format.
+
+#define REPLAY_OUTPUT  0
+#define REPLAY_FEATURE 1
+
+const uint8_t capture[] PROGMEM = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+	  0x0C, 0x04, // Device Control: Reset
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+	  0x0C, 0x01, // Device Control: Enable Actuators
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x02,
+	  0x0D, 0xFF, // Device Gain 255
+	0x0A, 0x00, 0x00, 0x00, 0x01, 0x04,
+	  0x05, 0x01, 0x00, 0x00, // Create New Effect: Constant Force -> effect 1
+	0x0B, 0x00, 0x00, 0x00, 0x00, 0x14,
+	  0x01, 0x01, 0x01, 0xDC, 0x05, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // Set Effect 1: 1500 ms, direction 90 deg
+	0x0B, 0x00, 0x00, 0x00, 0x00, 0x04,
+	  0x05, 0x01, 0x70, 0x17, // Set Constant Force 1: 6000
+	0x0C, 0x00, 0x00, 0x00, 0x00, 0x04,
+	  0x0A, 0x01, 0x01, 0x01, // Effect Operation: Start 1
+	0xC8, 0x00, 0x00, 0x00, 0x01, 0x04,
+	  0x05, 0x04, 0x00, 0x00, // Create New Effect: Sine -> effect 2
+	0xC9, 0x00, 0x00, 0x00, 0x00, 0x14,
+	  0x01, 0x02, 0x04, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // Set Effect 2: infinite, direction 90 deg
+	0xC9, 0x00, 0x00, 0x00, 0x00, 0x0E,
+	  0x04, 0x02, 0xA0, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00, // Set Periodic 2: magnitude 4000, period 100 ms
+	0xCA, 0x00, 0x00, 0x00, 0x00, 0x04,
+	  0x0A, 0x02, 0x01, 0x01, // Effect Operation: Start 2
+	0x90, 0x01, 0x00, 0x00, 0x01, 0x04,
+	  0x05, 0x08, 0x00, 0x00, // Create New Effect: Spring -> effect 3
+	0x91, 0x01, 0x00, 0x00, 0x00, 0x14,
+	  0x01, 0x03, 0x08, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // Set Effect 3: infinite, X and Y
+	0x91, 0x01, 0x00, 0x00, 0x00, 0x0F,
+	  0x03, 0x03, 0x00, 0x00, 0x00, 0x88, 0x13, 0x88, 0x13, 0x10, 0x27, 0x10, 0x27, 0x00, 0x00, // Set Condition 3 axis 0
+	0x91, 0x01, 0x00, 0x00, 0x00, 0x0F,
+	  0x03, 0x03, 0x01, 0x00, 0x00, 0x88, 0x13, 0x88, 0x13, 0x10, 0x27, 0x10, 0x27, 0x00, 0x00, // Set Condition 3 axis 1
+	0x92, 0x01, 0x00, 0x00, 0x00, 0x04,
+	  0x0A, 0x03, 0x01, 0x01, // Effect Operation: Start 3
+	0x20, 0x03, 0x00, 0x00, 0x00, 0x04,
+	  0x0A, 0x02, 0x03, 0x00, // Effect Operation: Stop 2
+	0x84, 0x03, 0x00, 0x00, 0x00, 0x02,
+	  0x0C, 0x05, // Device Control: Pause
+	0xE8, 0x03, 0x00, 0x00, 0x00, 0x02,
+	  0x0C, 0x06, // Device Control: Continue
+	0xB0, 0x04, 0x00, 0x00, 0x00, 0x02,
+	  0x0B, 0x02, // Block Free 2
+	0x08, 0x07, 0x00, 0x00, 0x00, 0x02,
+	  0x0C, 0x03, // Device Control: Stop All Effects
+	0x6C, 0x07, 0x00, 0x00, 0x00, 0x02,
+	  0x0C, 0x04, // Device Control: Reset
+};
@@ -0,0 +1,52 @@
+// Prints the RAM the joystick below takes, part by part, over Serial.
+// Change the constructor, MAX_EFFECTS or MAX_FFB_AXIS_COUNT to see what a
+// configuration costs. On AVR the free RAM between heap and stack is
+// printed too. Budgets that fail the build are set with the
+// JOYSTICK_RAM_BUDGET, FFB_RAM_BUDGET and JOYSTICK_SHARED_RAM_BUDGET
+// build flags, see Joystick.h.
+//------------------------------------------------------------
+#include "Joystick.h"
+
+Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID,
+  JOYSTICK_TYPE_JOYSTICK, 8, 0,
+  true, true, false, //X,Y,Z
+  false, false, false,//Rx,Ry,Rz
+  false, false, false, false, false);
+
+#if defined(__AVR__)
+extern char __heap_start;
+extern char* __brkval;
+
+int freeRam(){
+  char top;
+  return &top - (__brkval ? __brkval : &__heap_start);
+}
+#endif
+
+void printLine(const char* name, uint16_t bytes){
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.println(bytes);
+}
+
+void setup(){
+  Serial.begin(115200);
+  while (!Serial);
+  Joystick.begin();
+
+  JoystickMemoryUsage usage;
+  Joystick.getMemoryUsage(usage);
+  printLine("Joystick_ object", usage.joystick);
+  printLine("force feedback state (heap)", usage.pidHandler);
+  printLine("  of which effect table", usage.effectStates);
+  printLine("report descriptor (heap)", usage.descriptor);
+  printLine("reports (heap)", usage.reports);
+  printLine("shared buffers", usage.shared);
+  printLine("total", usage.joystick + usage.pidHandler + usage.descriptor + usage.reports + usage.shared);
+#if defined(__AVR__)
+  printLine("free RAM", freeRam());
+#endif
+}
+
+void loop(){
+}
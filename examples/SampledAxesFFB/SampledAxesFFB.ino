@@ -0,0 +1,60 @@
+// Force feedback wheel whose axes are sampled by the ADC interrupt.
+//
+// AxisSampler converts A2 (steering) and A3 (throttle) in the background,
+// so loop() only picks up finished values and spends the rest of its
+// time on force feedback. A report is sent only when an axis moved by
+// more than the hysteresis.
+//------------------------------------------------------------
+#include "Joystick.h"
+#include "AxisSampler.h"
+
+//X-axis & Y-axis REQUIRED
+Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID, 
+  JOYSTICK_TYPE_MULTI_AXIS, 4, 0,
+  true, true, false, //X,Y,Z
+  false, false, false,//Rx,Ry,Rz
+  false, true, false, false, false);//throttle
+
+AxisSampler sampler(2);//hysteresis
+AXIS_SAMPLER_ISR
+
+
+Gains mygains[MAX_FFB_AXIS_COUNT];
+EffectParams myeffectparams[MAX_FFB_AXIS_COUNT];
+int32_t forces[MAX_FFB_AXIS_COUNT] = {0};
+
+void setup(){
+    pinMode(9,OUTPUT);
+    pinMode(6,OUTPUT);
+    pinMode(7,OUTPUT);
+    Joystick.setXAxisRange(0, 1023);
+    Joystick.setThrottleRange(0, 1023);
+    mygains[0].totalGain = 100;//0-100
+    mygains[0].springGain = 100;//0-100
+    Joystick.setGains(mygains);
+    Joystick.setEffectParams(myeffectparams);
+    sampler.addAxis(A2, AXIS_SAMPLER_X);
+    sampler.addAxis(A3, AXIS_SAMPLER_THROTTLE);
+    sampler.begin();
+    Joystick.begin();
+}
+
+void loop(){
+  //Send HID data to PC when an axis moved
+  sampler.update(Joystick);
+
+  myeffectparams[0].springMaxPosition = 1023;
+  myeffectparams[0].springPosition = sampler.getValue(0);//0-1023
+
+  //Recv HID-PID data from PC and caculate forces
+  Joystick.getForce(forces);
+  if(forces[0] > 0){
+    digitalWrite(6,LOW);
+    digitalWrite(7,HIGH);
+    analogWrite(9,abs(forces[0]));
+  }else{
+    digitalWrite(6,HIGH);
+    digitalWrite(7,LOW);
+    analogWrite(9,abs(forces[0]));
+  }
+}
@@ -7,9 +7,9 @@ Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID,
   false, false, false,//Rx,Ry,Rz
   false, false, false, false, false);
 
-Gains mygains[2];
-EffectParams myeffectparams[2];
-int32_t forces[2] = {0};
+Gains mygains[MAX_FFB_AXIS_COUNT];
+EffectParams myeffectparams[MAX_FFB_AXIS_COUNT];
+int32_t forces[MAX_FFB_AXIS_COUNT] = {0};
 
 void setup(){
     pinMode(A2,INPUT);
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Compare two runs of the FFBBenchmark example.
+
+Save the Serial output of a known good build as the baseline, for example
+    cat /dev/ttyACM0 > baseline.csv
+then compare the output of a later build against it:
+    ffbbenchcompare.py baseline.csv current.csv [tolerance %]
+
+Every benchmark slower than the baseline by more than the tolerance
+(default 5 %) is reported, and the exit status is 1 if there is any.
+"""
+import sys
+
+
+def results(path):
+	times = {}
+	with open(path) as f:
+		for line in f:
+			fields = line.strip().split(',')
+			if len(fields) != 3 or line.startswith('#'):
+				continue
+			try:
+				times[fields[0]] = float(fields[2])
+			except ValueError:
+				continue
+	return times
+
+
+def main():
+	if len(sys.argv) not in (3, 4):
+		sys.exit(__doc__)
+	baseline = results(sys.argv[1])
+	current = results(sys.argv[2])
+	tolerance = float(sys.argv[3]) if len(sys.argv) == 4 else 5.0
+
+	regressions = 0
+	print('%-28s %10s %10s %8s' % ('benchmark', 'baseline', 'current', 'change'))
+	for name, time in current.items():
+		if name not in baseline:
+			print('%-28s %10s %10.2f %8s' % (name, '-', time, 'new'))
+			continue
+		base = baseline[name]
+		change = (time - base) * 100.0 / base if base > 0 else 0.0
+		slower = change > tolerance
+		regressions += slower
+		print('%-28s %10.2f %10.2f %+7.1f%%%s' % (name, base, time, change, '  SLOWER' if slower else ''))
+	for name in baseline:
+		if name not in current:
+			print('%-28s %10.2f %10s %8s' % (name, baseline[name], '-', 'missing'))
+
+	if regressions:
+		print('%d benchmark(s) slower than the baseline by more than %g%%' % (regressions, tolerance))
+		sys.exit(1)
+
+
+if __name__ == '__main__':
+	main()
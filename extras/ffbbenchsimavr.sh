@@ -0,0 +1,19 @@
+#!/bin/sh
+# Builds examples/FFBBenchmark for a Leonardo (ATmega32u4) with cycle
+# counting and runs it in simavr. Prints the benchmark lines, with the
+# times in CPU cycles per call:
+#     ffbbenchsimavr.sh > cycles.csv
+# At 16 MHz a 1 kHz force loop has 16000 cycles per getForce().
+# The output works with ffbbenchcompare.py like the one of the board.
+# Needs arduino-cli with the arduino:avr core, and simavr.
+set -e
+library=$(cd "$(dirname "$0")/.." && pwd)
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+arduino-cli compile --fqbn arduino:avr:leonardo --library "$library" \
+	--build-property "compiler.cpp.extra_flags=-DBENCH_CYCLES=1 -DBENCH_SERIAL=Serial1" \
+	--output-dir "$build" "$library/examples/FFBBenchmark" >&2
+# simavr logs the UART lines in color, keep the benchmark lines only
+simavr -m atmega32u4 -f 16000000 "$build/FFBBenchmark.ino.elf" 2>&1 |
+	sed 's/\x1b\[[0-9;]*m//g' | grep -oE '(# .*|[a-z0-9_]+,[0-9]+,[0-9.]+)$'
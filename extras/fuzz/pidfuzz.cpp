@@ -0,0 +1,132 @@
+// Feeds arbitrary PID traffic to the report handler of a force feedback
+// joystick and runs the force engine after every report, the way
+// FFBReplay does with a capture. Built on the host by pidfuzz.sh, with
+// libFuzzer when clang has it and as a random packet driver otherwise,
+// both under the address and undefined behaviour sanitizers.
+//
+// An input is a list of records: a length byte, then that many report
+// bytes, report ID first. Create New Effect (report ID 5) is taken as
+// the feature report, every other ID as an output report. The clock
+// advances one millisecond per record.
+#include <stdio.h>
+#include "Joystick.h"
+
+HostSerial Serial;
+volatile uint32_t hostInputRegister;
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+static unsigned long now = 0;
+unsigned long millis(void) { return now; }
+unsigned long micros(void) { return now * 1000; }
+static unsigned long virtualClock() { return now; }
+
+int USB_SendControl(uint8_t, const void*, int len) { return len; }
+int USB_RecvControl(void*, int len) { return len; }
+int USB_Send(uint8_t, const void*, int len) { return len; }
+int USB_Recv(uint8_t, void*, int) { return -1; }
+int USB_Recv(uint8_t) { return -1; }
+uint8_t USB_Available(uint8_t) { return 0; }
+uint8_t USB_SendSpace(uint8_t) { return USB_EP_SIZE; }
+PluggableUSB_& PluggableUSB() { static PluggableUSB_ usb; return usb; }
+
+static Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID,
+	JOYSTICK_TYPE_JOYSTICK, 4, 0,
+	true, true, false, //X,Y,Z
+	false, false, false,//Rx,Ry,Rz
+	false, false, false, false, false, true);
+
+static Gains gains[MAX_FFB_AXIS_COUNT];
+static EffectParams effectParams[MAX_FFB_AXIS_COUNT];
+
+static void setUp()
+{
+	static bool done = false;
+	if (done)
+		return;
+	for (int i = 0; i < MAX_FFB_AXIS_COUNT; i++) {
+		gains[i].totalGain = 100;
+		effectParams[i].springMaxPosition = 512;
+		effectParams[i].damperMaxVelocity = 128;
+		effectParams[i].inertiaMaxAcceleration = 128;
+		effectParams[i].frictionMaxPositionChange = 128;
+	}
+	Joystick.setGains(gains);
+	Joystick.setEffectParams(effectParams);
+	Joystick.setClock(virtualClock);
+	Joystick.begin();
+	done = true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* input, size_t size)
+{
+	setUp();
+	uint8_t pidReportId;
+	PIDReportHandler* handler = DynamicHID().findPIDReportHandler(JOYSTICK_DEFAULT_REPORT_ID, &pidReportId);
+	if (handler == NULL)
+		return 0;
+	// Start every input from an empty pool
+	handler->FreeAllEffects();
+
+	int32_t forces[MAX_FFB_AXIS_COUNT];
+	while (size > 0) {
+		size_t len = min((size_t)input[0], size - 1);
+		// A copy of exactly len bytes so the sanitizer sees reads past the report
+		uint8_t* report = (uint8_t*)malloc(len ? len : 1);
+		memcpy(report, input + 1, len);
+		input += 1 + len;
+		size -= 1 + len;
+
+		if (len > 0 && DynamicHID().findPIDReportHandler(report[0], &pidReportId) == handler) {
+			report[0] = pidReportId;
+			if (pidReportId == 5) {
+				if (len >= sizeof(USB_FFBReport_CreateNewEffect_Feature_Data_t))
+					handler->CreateNewEffect((USB_FFBReport_CreateNewEffect_Feature_Data_t*)report);
+			}
+			else
+				handler->UppackUsbData(report, len);
+		}
+		// Move the axes with the last byte of the record
+		int8_t motion = len ? (int8_t)report[len - 1] : 0;
+		for (int i = 0; i < MAX_FFB_AXIS_COUNT; i++) {
+			effectParams[i].springPosition = motion * 4;
+			effectParams[i].damperVelocity = motion;
+			effectParams[i].inertiaAcceleration = motion;
+			effectParams[i].frictionPositionChange = motion;
+		}
+		free(report);
+		now++;
+		Joystick.getForce(forces);
+	}
+	return 0;
+}
+
+#ifdef PIDFUZZ_STANDALONE
+// Without libFuzzer: random records biased towards valid report IDs and
+// allocated effects, as many inputs as the first argument says.
+int main(int argc, char** argv)
+{
+	long runs = argc > 1 ? atol(argv[1]) : 100000;
+	srand(argc > 2 ? atoi(argv[2]) : 1);
+	uint8_t input[1024];
+	for (long run = 0; run < runs; run++) {
+		size_t size = 0;
+		while (size + 1 + 24 <= sizeof(input) && rand() % 40 != 0) {
+			uint8_t len = rand() % 24;
+			input[size++] = len;
+			for (int i = 0; i < len; i++)
+				input[size + i] = rand();
+			if (len > 0)
+				input[size] = JOYSTICK_DEFAULT_REPORT_ID + rand() % (PID_REPORT_ID_COUNT + 1);
+			if (len > 1 && rand() % 2)
+				input[size + 1] = rand() % (MAX_EFFECTS + 2);
+			if (len > 1 && input[size] == JOYSTICK_DEFAULT_REPORT_ID + 4)
+				input[size + 1] = 1 + rand() % USB_EFFECT_FRICTION;
+			size += len;
+		}
+		LLVMFuzzerTestOneInput(input, size);
+	}
+	printf("%ld inputs\n", runs);
+	return 0;
+}
+#endif
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Builds pidfuzz.cpp against the library sources on the host and runs it
+# under the address and undefined behaviour sanitizers, with the Arduino
+# stand-ins in extras/host:
+#     pidfuzz.sh [runs] [seed]
+# With clang and libFuzzer it runs libFuzzer for [runs] inputs, otherwise
+# the random driver in pidfuzz.cpp. The report structs are packed on every
+# target, the internal structs such as TEffectState keep their natural
+# padding, as on the Due. Any sanitizer report stops the run with a
+# non-zero status.
+# Extra compiler flags come from CXXFLAGS, e.g. CXXFLAGS=-DMAX_FFB_AXIS_COUNT=3
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../../src"
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+flags="-std=gnu++11 -g -O1 -fpermissive -w -fno-sanitize-recover=all -I$here/../host -I$src -I$src/DynamicHID $CXXFLAGS"
+sources="$here/pidfuzz.cpp $src/Joystick.cpp $src/DynamicHID/DynamicHID.cpp $src/DynamicHID/PIDReportHandler.cpp $src/DynamicHID/FFBProfile.cpp"
+
+if command -v clang++ >/dev/null && echo 'extern "C" int LLVMFuzzerTestOneInput(const unsigned char*, unsigned long){return 0;}' |
+	clang++ -x c++ -fsanitize=fuzzer -o "$build/probe" - 2>/dev/null; then
+	clang++ $flags -fsanitize=fuzzer,address,undefined -o "$build/pidfuzz" $sources
+	"$build/pidfuzz" -runs="${1:-1000000}" -seed="${2:-1}" -max_len=1024
+else
+	${CXX:-g++} $flags -DPIDFUZZ_STANDALONE -fsanitize=address,undefined -o "$build/pidfuzz" $sources
+	"$build/pidfuzz" "${1:-100000}" "${2:-1}"
+fi
@@ -0,0 +1,102 @@
+// Just enough of the Arduino core to build the library on the host, for
+// the harnesses in extras and the example sketches sketch.cpp runs. The
+// harness defines the functions declared here.
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+using std::min;
+using std::max;
+
+#define ARDUINO 10813
+#define USBCON
+#define PROGMEM
+#define PI 3.1415926535897932384626433832795
+typedef uint8_t byte;
+
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define memcpy_P memcpy
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define B00000001 1
+#define B00000010 2
+#define B00000100 4
+#define B00001000 8
+#define B00010000 16
+#define B00100000 32
+#define B00001111 15
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+unsigned long millis(void);
+unsigned long micros(void);
+// Nanoseconds since the start, for timing below a microsecond on the host
+unsigned long hostNanos(void);
+inline void _delay_us(double) {}
+inline void delayMicroseconds(unsigned int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Pins: every pin is bit pin % 32 of a single input register
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define LOW 0x0
+#define HIGH 0x1
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+extern volatile uint32_t hostInputRegister;
+#define digitalPinToPort(pin) 0
+#define portInputRegister(port) (&hostInputRegister)
+#define digitalPinToBitMask(pin) (1UL << ((pin) % 32))
+
+// Serial writes to stdout, numbers as the Arduino Print class formats them
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+struct HostSerial {
+	void begin(unsigned long) {}
+	void flush() { fflush(stdout); }
+	operator bool() { return true; }
+	void print(const char* s) { fputs(s, stdout); }
+	void print(char c) { putchar(c); }
+	void print(unsigned long n, int base = DEC)
+	{
+		char digits[8 * sizeof(n) + 1];
+		char* p = &digits[sizeof(digits) - 1];
+		*p = 0;
+		do {
+			*--p = "0123456789ABCDEF"[n % base];
+			n /= base;
+		} while (n);
+		print(p);
+	}
+	void print(long n, int base = DEC)
+	{
+		if (n < 0 && base == DEC) {
+			print('-');
+			n = -n;
+		}
+		print((unsigned long)n, base);
+	}
+	void print(unsigned int n, int base = DEC) { print((unsigned long)n, base); }
+	void print(int n, int base = DEC) { print((long)n, base); }
+	void print(unsigned char n, int base = DEC) { print((unsigned long)n, base); }
+	void print(double n, int digits = 2) { printf("%.*f", digits, n); }
+	template<class T> void println(T value) { print(value); println(); }
+	template<class T> void println(T value, int format) { print(value, format); println(); }
+	void println() { print('\n'); }
+};
+extern HostSerial Serial;
+#endif
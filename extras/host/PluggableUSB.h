@@ -0,0 +1,62 @@
+// Host stand-in for the Arduino PluggableUSB core, see Arduino.h.
+#ifndef HOST_PLUGGABLEUSB_H
+#define HOST_PLUGGABLEUSB_H
+#include "Arduino.h"
+
+struct USBSetup {
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+	uint8_t wValueL;
+	uint8_t wValueH;
+	uint16_t wIndex;
+	uint16_t wLength;
+};
+typedef struct { uint8_t b[9]; } InterfaceDescriptor;
+typedef struct { uint8_t b[7]; } EndpointDescriptor;
+#define D_INTERFACE(n, eps, cls, sub, proto) {{ 9, 4, n, 0, eps, cls, sub, proto, 0 }}
+#define D_ENDPOINT(addr, attr, size, interval) {{ 7, 5, addr, attr, size, 0, interval }}
+#define USB_DEVICE_CLASS_HUMAN_INTERFACE 3
+#define USB_ENDPOINT_IN(x) ((x) | 0x80)
+#define USB_ENDPOINT_OUT(x) (x)
+#define USB_ENDPOINT_TYPE_INTERRUPT 3
+#define USB_EP_SIZE 64
+#define TRANSFER_PGM 0x80
+#define TRANSFER_RELEASE 0x40
+#define TRANSFER_ZERO 0x20
+#define EP_TYPE_INTERRUPT_IN 0xC1
+#define EP_TYPE_INTERRUPT_OUT 0xC0
+#define REQUEST_DEVICETOHOST_STANDARD_INTERFACE 0x81
+#define REQUEST_DEVICETOHOST_CLASS_INTERFACE 0xA1
+#define REQUEST_HOSTTODEVICE_CLASS_INTERFACE 0x21
+
+int USB_SendControl(uint8_t flags, const void* data, int len);
+int USB_RecvControl(void* data, int len);
+int USB_Send(uint8_t ep, const void* data, int len);
+int USB_Recv(uint8_t ep, void* data, int len);
+int USB_Recv(uint8_t ep);
+uint8_t USB_Available(uint8_t ep);
+uint8_t USB_SendSpace(uint8_t ep);
+
+class PluggableUSBModule {
+public:
+	PluggableUSBModule(uint8_t numEps, uint8_t numIfs, uint8_t* epType) :
+		numEndpoints(numEps), numInterfaces(numIfs), endpointType(epType) {}
+protected:
+	virtual bool setup(USBSetup& setup) = 0;
+	virtual int getInterface(uint8_t* interfaceCount) = 0;
+	virtual int getDescriptor(USBSetup& setup) = 0;
+	virtual uint8_t getShortName(char* name) { name[0] = 'A'; return 1; }
+	uint8_t pluggedInterface = 0;
+	uint8_t pluggedEndpoint = 1;
+	const uint8_t numEndpoints;
+	const uint8_t numInterfaces;
+	const uint8_t* endpointType;
+	PluggableUSBModule* next = NULL;
+};
+
+class PluggableUSB_ {
+public:
+	bool plug(PluggableUSBModule*) { return true; }
+};
+PluggableUSB_& PluggableUSB();
+#endif
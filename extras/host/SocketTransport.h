@@ -0,0 +1,35 @@
+// DynamicHIDTransport over a Linux socket, one report per packet. The
+// device end of a socketpair(AF_UNIX, SOCK_SEQPACKET) goes here, the
+// other end plays the host: it writes the PID output reports and reads
+// the input reports, from another thread or process. Never blocks.
+#ifndef HOST_SOCKET_TRANSPORT_H
+#define HOST_SOCKET_TRANSPORT_H
+#include <poll.h>
+#include <sys/socket.h>
+#include "DynamicHID.h"
+
+class SocketTransport : public DynamicHIDTransport {
+public:
+	explicit SocketTransport(int fd) : fd(fd) {}
+
+	int send(const void* data, int len) {
+		return ::send(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+	int sendSpace() {
+		struct pollfd p = {fd, POLLOUT, 0};
+		return poll(&p, 1, 0) == 1 && (p.revents & POLLOUT) ? USB_EP_SIZE : 0;
+	}
+	int available() {
+		// MSG_TRUNC gives the length of the whole packet, not of the buffer
+		uint8_t byte;
+		int len = ::recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT | MSG_TRUNC);
+		return len > 0 ? len : 0;
+	}
+	int recv(void* data, int len) {
+		return ::recv(fd, data, len, MSG_DONTWAIT);
+	}
+
+private:
+	int fd;
+};
+#endif
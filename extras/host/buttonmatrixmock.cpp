@@ -0,0 +1,179 @@
+// Runs ButtonMatrix against a simulated matrix on the host, checks the
+// debouncing through the reports the joystick sends, then times scan().
+// Built and run by buttonmatrixmock.sh.
+//
+// The simulated buttons short their column pin to the row pin driven
+// LOW, like the real matrix. Column pins are 0..15 and read from the
+// single input register of Arduino.h, row pins are 16 and up.
+#include <stdio.h>
+#include <chrono>
+#include "Joystick.h"
+#include "ButtonMatrix.h"
+
+HostSerial Serial;
+
+unsigned long millis(void) { return 0; }
+unsigned long micros(void) { return 0; }
+
+int USB_SendControl(uint8_t, const void*, int len) { return len; }
+int USB_RecvControl(void*, int len) { return len; }
+int USB_Send(uint8_t, const void*, int len) { return len; }
+int USB_Recv(uint8_t, void*, int) { return -1; }
+int USB_Recv(uint8_t) { return -1; }
+uint8_t USB_Available(uint8_t) { return 0; }
+uint8_t USB_SendSpace(uint8_t) { return USB_EP_SIZE; }
+PluggableUSB_& PluggableUSB() { static PluggableUSB_ usb; return usb; }
+
+#define ROW_PIN 16
+#define MAX_ROWS 8
+#define MAX_COLUMNS 16
+
+static bool pressed[MAX_ROWS][MAX_COLUMNS];
+static int drivenRow = -1;
+volatile uint32_t hostInputRegister = 0xFFFFFFFF;
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	if (pin < ROW_PIN)
+		return;
+	if (value == LOW)
+		drivenRow = pin - ROW_PIN;
+	else if (drivenRow == pin - ROW_PIN)
+		drivenRow = -1;
+	uint32_t columns = 0xFFFFFFFF;
+	if (drivenRow >= 0)
+		for (int column = 0; column < MAX_COLUMNS; column++)
+			if (pressed[drivenRow][column])
+				columns &= ~(1UL << column);
+	hostInputRegister = columns;
+}
+
+// Keeps the reports the joystick sends instead of sending them over USB
+class ReportCapture : public DynamicHIDTransport {
+public:
+	uint8_t report[USB_EP_SIZE];
+	int reports = 0;
+
+	int send(const void* data, int len) {
+		memcpy(report, data, len);
+		reports++;
+		return len;
+	}
+	int sendSpace() { return USB_EP_SIZE; }
+	int available() { return 0; }
+	int recv(void*, int) { return -1; }
+};
+
+static ReportCapture capture;
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+	printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+	failures += !ok;
+}
+
+static const uint8_t rowPins[MAX_ROWS] = {16, 17, 18, 19, 20, 21, 22, 23};
+static const uint8_t columnPins[MAX_COLUMNS] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+// 4x4 matrix, button n is row n / 4, column n % 4
+static Joystick_ Pad(JOYSTICK_DEFAULT_REPORT_ID,
+	JOYSTICK_TYPE_GAMEPAD, 16, 0,
+	false, false, false, //X,Y,Z
+	false, false, false,//Rx,Ry,Rz
+	false, false, false, false, false,
+	false);//no force feedback
+static ButtonMatrix matrix(rowPins, 4, columnPins, 4);
+
+// 8x16 matrix with the most buttons a ButtonMatrix takes
+static Joystick_ Box(JOYSTICK_DEFAULT_REPORT_ID + 1,
+	JOYSTICK_TYPE_GAMEPAD, 128, 0,
+	false, false, false, //X,Y,Z
+	false, false, false,//Rx,Ry,Rz
+	false, false, false, false, false,
+	false);//no force feedback
+static ButtonMatrix bigMatrix(rowPins, 8, columnPins, 16);
+
+static uint16_t buttons()
+{
+	return capture.report[1] | capture.report[2] << 8;
+}
+
+// Scans count times, returns the scans that reported a change
+static int scans(int count)
+{
+	int changes = 0;
+	for (int i = 0; i < count; i++)
+		changes += matrix.scan(Pad);
+	return changes;
+}
+
+static void checkDebounce()
+{
+	memset(pressed, 0, sizeof(pressed));
+	int reports = capture.reports;
+
+	pressed[1][2] = true; // button 6
+	check(scans(BUTTON_MATRIX_DEBOUNCE_SCANS - 1) == 0, "press not reported before the debounce scans");
+	check(scans(1) == 1 && buttons() == 1 << 6, "press reported on the last debounce scan");
+	check(capture.reports == reports + 1, "one report per press");
+
+	pressed[1][2] = false;
+	scans(BUTTON_MATRIX_DEBOUNCE_SCANS - 1);
+	pressed[1][2] = true;
+	check(scans(3 * BUTTON_MATRIX_DEBOUNCE_SCANS) == 0 && buttons() == 1 << 6, "bounce shorter than the debounce scans ignored");
+
+	pressed[3][3] = true; // button 15
+	pressed[0][0] = true; // button 0
+	scans(BUTTON_MATRIX_DEBOUNCE_SCANS);
+	check(buttons() == (1 << 0 | 1 << 6 | 1 << 15), "buttons of several rows together");
+
+	pressed[1][2] = false;
+	check(scans(BUTTON_MATRIX_DEBOUNCE_SCANS) == 1 && buttons() == (1 << 0 | 1 << 15), "release reported after the debounce scans");
+
+	for (int row = 0; row < 4; row++)
+		for (int column = 0; column < 4; column++)
+			pressed[row][column] = true;
+	scans(BUTTON_MATRIX_DEBOUNCE_SCANS);
+	check(buttons() == 0xFFFF, "all buttons");
+
+	memset(pressed, 0, sizeof(pressed));
+	scans(BUTTON_MATRIX_DEBOUNCE_SCANS);
+	check(buttons() == 0, "all released");
+}
+
+// Host time per scan() with a button pressed and released every few scans.
+// Compare the numbers of two builds on the same PC, the board's scan rate
+// comes from examples/ButtonBoxMatrix.
+static void benchmark(const char* name, ButtonMatrix& m, Joystick_& joystick, int rows, int columns)
+{
+	const long calls = 200000;
+	memset(pressed, 0, sizeof(pressed));
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < calls; i++) {
+		if (i % 16 == 0)
+			pressed[(i / 16) % rows][(i / 256) % columns] ^= true;
+		m.scan(joystick);
+	}
+	auto end = std::chrono::steady_clock::now();
+	printf("%s,%ld,%.1f\n", name, calls,
+		std::chrono::duration<double, std::nano>(end - start).count() / calls);
+}
+
+int main()
+{
+	DynamicHID().setTransport(&capture);
+	Pad.begin();
+	Box.begin();
+	matrix.begin();
+	bigMatrix.begin();
+
+	checkDebounce();
+
+	printf("# name,calls,ns_per_call\n");
+	benchmark("scan_4x4", matrix, Pad, 4, 4);
+	benchmark("scan_8x16", bigMatrix, Box, 8, 16);
+	return failures ? 1 : 0;
+}
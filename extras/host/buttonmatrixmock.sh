@@ -0,0 +1,16 @@
+#!/bin/sh
+# Builds buttonmatrixmock.cpp against the library sources on the host and
+# runs it. It prints a line per debounce check, then the host time per
+# scan() as name,calls,ns_per_call lines, and exits with status 1 if a
+# check failed. Extra compiler flags come from CXXFLAGS, e.g.
+#     CXXFLAGS=-DBUTTON_MATRIX_SETTLE_US=0 buttonmatrixmock.sh
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../../src"
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+${CXX:-g++} -std=gnu++11 -O2 -fpermissive -w -I"$here" -I"$src" -I"$src/DynamicHID" $CXXFLAGS \
+	-o "$build/buttonmatrixmock" "$here/buttonmatrixmock.cpp" "$src/ButtonMatrix.cpp" "$src/Joystick.cpp" \
+	"$src/DynamicHID/DynamicHID.cpp" "$src/DynamicHID/PIDReportHandler.cpp" "$src/DynamicHID/FFBProfile.cpp"
+"$build/buttonmatrixmock"
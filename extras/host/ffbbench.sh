@@ -0,0 +1,26 @@
+#!/bin/sh
+# Builds examples/FFBBenchmark against the library sources on the host,
+# with sketch.cpp in place of the Arduino core, and runs it. Prints the
+# benchmark lines with the times in nanoseconds per call:
+#     ffbbench.sh > baseline.csv
+# The output works with ffbbenchcompare.py, compare builds on the same
+# PC only. BENCH_CALLS sets the calls per line (default 10000), extra
+# compiler flags come from CXXFLAGS, e.g. CXXFLAGS=-DMAX_EFFECTS=6
+# FFB_LIBRARY builds the library of another checkout with this sketch,
+# to time a change before and after it:
+#     git worktree add /tmp/before HEAD~1
+#     FFB_LIBRARY=/tmp/before ffbbench.sh > before.csv
+#     ffbbench.sh > after.csv
+#     ffbbenchcompare.py before.csv after.csv
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+src="${FFB_LIBRARY:-$here/../..}/src"
+sketch="$here/../../examples/FFBBenchmark"
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+${CXX:-g++} -std=gnu++11 -O2 -fpermissive -w -I"$here" -I"$src" -I"$src/DynamicHID" \
+	-DBENCH_CALLS=${BENCH_CALLS:-10000} -DBENCH_TIMER=hostNanos -DBENCH_UNIT='"ns"' -DBENCH_END='exit(0)' $CXXFLAGS \
+	-o "$build/ffbbench" "$here/sketch.cpp" -x c++ "$sketch/FFBBenchmark.ino" -x none "$src/Joystick.cpp" \
+	"$src/DynamicHID/DynamicHID.cpp" "$src/DynamicHID/PIDReportHandler.cpp" "$src/DynamicHID/FFBProfile.cpp"
+"$build/ffbbench"
@@ -0,0 +1,216 @@
+// Runs the whole report path through a Linux socketpair: the device
+// thread runs getForce() and sends the force back as the X axis, the
+// main thread plays the host on the other end of the socket. Checks the
+// PID State and joystick reports the host gets, then times round trips
+// of Set Constant Force -> getForce() -> input report. Built and run by
+// ffbloopback.sh.
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+#include "Joystick.h"
+#include "SocketTransport.h"
+
+HostSerial Serial;
+volatile uint32_t hostInputRegister = 0xFFFFFFFF;
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+unsigned long hostNanos(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+unsigned long micros(void) { return hostNanos() / 1000; }
+unsigned long millis(void) { return hostNanos() / 1000000; }
+
+int USB_SendControl(uint8_t, const void*, int len) { return len; }
+int USB_RecvControl(void*, int len) { return len; }
+int USB_Send(uint8_t, const void*, int len) { return len; }
+int USB_Recv(uint8_t, void*, int) { return -1; }
+int USB_Recv(uint8_t) { return -1; }
+uint8_t USB_Available(uint8_t) { return 0; }
+uint8_t USB_SendSpace(uint8_t) { return USB_EP_SIZE; }
+PluggableUSB_& PluggableUSB() { static PluggableUSB_ usb; return usb; }
+
+static Joystick_ Joystick(JOYSTICK_DEFAULT_REPORT_ID,
+	JOYSTICK_TYPE_JOYSTICK, 0, 0,
+	true, true, false, //X,Y,Z
+	false, false, false,//Rx,Ry,Rz
+	false, false, false, false, false, true);
+
+static Gains gains[MAX_FFB_AXIS_COUNT];
+static EffectParams effectParams[MAX_FFB_AXIS_COUNT];
+static std::atomic<bool> running(true);
+static int hostFd;
+static int deviceFd;
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+	printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+	failures += !ok;
+}
+
+// The device: a 1 kHz force loop that also runs as soon as a PID report
+// comes in. It sends the X force whenever it changes.
+static void device()
+{
+	int32_t forces[MAX_FFB_AXIS_COUNT] = {0};
+	int32_t sent = 0;
+	while (running) {
+		struct pollfd p = {deviceFd, POLLIN, 0};
+		poll(&p, 1, 1);
+		Joystick.getForce(forces);
+		if (forces[0] != sent) {
+			sent = forces[0];
+			Joystick.setXAxis(sent);
+		}
+	}
+}
+
+static void hostWrite(const void* report, int len)
+{
+	send(hostFd, report, len, MSG_NOSIGNAL);
+}
+
+// Returns the length of the next input report with this ID, or 0 if none
+// comes within a second. Reports of other IDs wait in skipped, so the
+// checks do not depend on the order of the PID State and joystick reports.
+static std::deque<std::vector<uint8_t> > skipped;
+
+static int hostRead(uint8_t id, uint8_t* report)
+{
+	for (auto it = skipped.begin(); it != skipped.end(); ++it) {
+		if ((*it)[0] == id) {
+			int len = it->size();
+			memcpy(report, it->data(), len);
+			skipped.erase(it);
+			return len;
+		}
+	}
+	struct pollfd p = {hostFd, POLLIN, 0};
+	while (poll(&p, 1, 1000) == 1) {
+		int len = recv(hostFd, report, USB_EP_SIZE, 0);
+		if (len > 0 && report[0] == id)
+			return len;
+		if (len > 0)
+			skipped.push_back(std::vector<uint8_t>(report, report + len));
+	}
+	return 0;
+}
+
+// Waits for the joystick report whose X axis carries this force, the
+// report packs X first. X maps the forces -255..255 onto -32767..32767,
+// rounded here back to a force. The force may be one step off, e.g.
+// +10000 gives 254 and -10000 gives -255.
+static bool hostReadForce(int force)
+{
+	uint8_t report[USB_EP_SIZE];
+	while (hostRead(JOYSTICK_DEFAULT_REPORT_ID, report) >= 3) {
+		long x = (int16_t)(report[1] | report[2] << 8);
+		if (abs(lround(x * 255.0 / 32767) - force) <= 1)
+			return true;
+	}
+	return false;
+}
+
+static bool hostReadPIDState(uint8_t effectBlockIndex)
+{
+	uint8_t report[USB_EP_SIZE];
+	return hostRead(JOYSTICK_DEFAULT_REPORT_ID + 1, report) == sizeof(USB_FFBReport_PIDStatus_Input_Data_t) &&
+		report[2] == effectBlockIndex;
+}
+
+static void setConstantForce(int16_t magnitude)
+{
+	USB_FFBReport_SetConstantForce_Output_Data_t constant = {JOYSTICK_DEFAULT_REPORT_ID + 4, 1, magnitude};
+	hostWrite(&constant, sizeof(constant));
+}
+
+static void effectOperation(uint8_t operation)
+{
+	USB_FFBReport_EffectOperation_Output_Data_t op = {JOYSTICK_DEFAULT_REPORT_ID + 9, 1, operation, 0};
+	hostWrite(&op, sizeof(op));
+}
+
+int main()
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) {
+		perror("socketpair");
+		return 1;
+	}
+	hostFd = fds[0];
+	deviceFd = fds[1];
+	SocketTransport transport(deviceFd);
+
+	for (int i = 0; i < MAX_FFB_AXIS_COUNT; i++)
+		gains[i].totalGain = 100;
+	Joystick.setGains(gains);
+	Joystick.setEffectParams(effectParams);
+	Joystick.setXAxisRange(-255, 255);
+	DynamicHID().setTransport(&transport);
+	Joystick.begin();
+
+	// Create New Effect is a feature report, which stays on the control
+	// endpoint, so the host side calls the handler for it.
+	uint8_t pidReportId;
+	USB_FFBReport_CreateNewEffect_Feature_Data_t create = {5, USB_EFFECT_CONSTANT, 0};
+	DynamicHID().findPIDReportHandler(JOYSTICK_DEFAULT_REPORT_ID + 4, &pidReportId)->CreateNewEffect(&create);
+	std::thread deviceThread(device);
+
+	// Constant force along X (90 degrees), infinite, block 1
+	USB_FFBReport_SetEffect_Output_Data_t effect;
+	memset(&effect, 0, sizeof(effect));
+	effect.reportId = JOYSTICK_DEFAULT_REPORT_ID;
+	effect.effectBlockIndex = 1;
+	effect.effectType = USB_EFFECT_CONSTANT;
+	effect.duration = USB_DURATION_INFINITE;
+	effect.gain = 255;
+	effect.enableAxis = X_AXIS_ENABLE;
+	effect.direction[0] = 64;
+	hostWrite(&effect, sizeof(effect));
+	setConstantForce(10000);
+	effectOperation(1);
+	check(hostReadPIDState(1 << 1 | 1), "PID State reports block 1 playing after Effect Operation Start");
+	check(hostReadForce(255), "full positive force comes back as X");
+	setConstantForce(-10000);
+	check(hostReadForce(-255), "full negative force comes back as X");
+
+	const long calls = 10000;
+	long trips = 0;
+	long mismatches = 0;
+	unsigned long latencyMin = 0xFFFFFFFF, latencyMax = 0, latencyTotal = 0;
+	unsigned long start = hostNanos();
+	for (long i = 0; i < calls; i++) {
+		int16_t magnitude = (i & 1) ? -10000 : 10000;
+		unsigned long sent = hostNanos();
+		setConstantForce(magnitude);
+		if (!hostReadForce(magnitude > 0 ? 255 : -255) && ++mismatches > 10)
+			break;
+		unsigned long latency = hostNanos() - sent;
+		latencyMin = min(latencyMin, latency);
+		latencyMax = max(latencyMax, latency);
+		latencyTotal += latency;
+		trips++;
+	}
+	unsigned long elapsed = hostNanos() - start;
+	check(mismatches == 0, "every round trip returns the force of its Set Constant Force");
+
+	effectOperation(3);
+	check(hostReadPIDState(1 << 1), "PID State reports block 1 stopped after Effect Operation Stop");
+	check(hostReadForce(0), "force back to 0 after the stop");
+
+	running = false;
+	deviceThread.join();
+
+	printf("# name,calls,ns_per_call\n");
+	printf("round_trip,%ld,%.1f\n", trips, (double)latencyTotal / trips);
+	printf("# latency ns min/mean/max: %lu/%lu/%lu\n", latencyMin, latencyTotal / trips, latencyMax);
+	printf("# round trips/s: %.0f\n", trips * 1e9 / elapsed);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/sh
+# Builds ffbloopback.cpp against the library sources on the host and
+# runs it. The device thread talks to the host over a Linux socketpair
+# through SocketTransport.h. It prints a line per report check, then the
+# round trip time as a name,calls,ns_per_call line with the min/mean/max
+# latency and the round trips per second, and exits with status 1 if a
+# check failed. Extra compiler flags come from CXXFLAGS, e.g.
+#     CXXFLAGS=-DMAX_FFB_AXIS_COUNT=1 ffbloopback.sh
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../../src"
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+${CXX:-g++} -std=gnu++11 -O2 -pthread -fpermissive -w -I"$here" -I"$src" -I"$src/DynamicHID" $CXXFLAGS \
+	-o "$build/ffbloopback" "$here/ffbloopback.cpp" "$src/Joystick.cpp" \
+	"$src/DynamicHID/DynamicHID.cpp" "$src/DynamicHID/PIDReportHandler.cpp" "$src/DynamicHID/FFBProfile.cpp"
+"$build/ffbloopback"
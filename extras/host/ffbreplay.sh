@@ -0,0 +1,31 @@
+#!/bin/sh
+# Builds examples/FFBReplay against the library sources on the host, with
+# sketch.cpp in place of the Arduino core, and runs it. Without an
+# argument it prints the force trace, one "time force0 force1 ..." line
+# per tick, save that as the golden trace:
+#     ffbreplay.sh > golden.txt
+# With a golden trace it diffs the new trace against it, prints the
+# differences and the throughput lines, and exits with status 1 if the
+# forces differ:
+#     ffbreplay.sh golden.txt
+# The "#" lines carry timings and are left out of the diff. Extra
+# compiler flags come from CXXFLAGS, e.g. CXXFLAGS=-DMAX_FFB_AXIS_COUNT=1
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../../src"
+sketch="$here/../../examples/FFBReplay"
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+${CXX:-g++} -std=gnu++11 -O2 -fpermissive -w -I"$here" -I"$src" -I"$src/DynamicHID" \
+	-DREPLAY_END='exit(0)' $CXXFLAGS \
+	-o "$build/ffbreplay" "$here/sketch.cpp" -x c++ "$sketch/FFBReplay.ino" -x none "$src/Joystick.cpp" \
+	"$src/DynamicHID/DynamicHID.cpp" "$src/DynamicHID/PIDReportHandler.cpp" "$src/DynamicHID/FFBProfile.cpp"
+if [ $# -eq 0 ]; then
+	"$build/ffbreplay"
+	exit
+fi
+"$build/ffbreplay" > "$build/trace.txt"
+grep '^#' "$build/trace.txt"
+grep -v '^#' "$1" > "$build/golden.txt" || true
+grep -v '^#' "$build/trace.txt" | diff "$build/golden.txt" -
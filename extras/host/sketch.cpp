@@ -0,0 +1,50 @@
+// Runs an example sketch on the host: main() calls setup() once and then
+// loop() over and over, like the Arduino core. Serial writes to stdout,
+// millis() and micros() count from the start of the program and the USB
+// endpoints take every report and have nothing to read, so a sketch that
+// talks to a host installs a DynamicHIDTransport. The sketch ends the
+// program with exit(). Built with the sketch by ffbbench.sh and
+// ffbreplay.sh.
+#include <chrono>
+#include "Joystick.h"
+
+void setup();
+void loop();
+
+HostSerial Serial;
+volatile uint32_t hostInputRegister = 0xFFFFFFFF;
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+unsigned long hostNanos(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros(void)
+{
+	return hostNanos() / 1000;
+}
+
+unsigned long millis(void)
+{
+	return micros() / 1000;
+}
+
+int USB_SendControl(uint8_t, const void*, int len) { return len; }
+int USB_RecvControl(void*, int len) { return len; }
+int USB_Send(uint8_t, const void*, int len) { return len; }
+int USB_Recv(uint8_t, void*, int) { return -1; }
+int USB_Recv(uint8_t) { return -1; }
+uint8_t USB_Available(uint8_t) { return 0; }
+uint8_t USB_SendSpace(uint8_t) { return USB_EP_SIZE; }
+PluggableUSB_& PluggableUSB() { static PluggableUSB_ usb; return usb; }
+
+int main()
+{
+	setup();
+	while (true)
+		loop();
+}
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Convert a Linux usbmon text capture into capture.h for the FFBReplay example.
+
+Capture a game session with the joystick plugged in:
+    cat /sys/kernel/debug/usb/usbmon/<bus>u > session.txt
+then convert the traffic sent to the joystick:
+    usbmon2replay.py session.txt <device number> > capture.h
+
+Interrupt OUT transfers and SET_REPORT(Output) requests become output records,
+SET_REPORT(Feature) requests (Create New Effect) become feature records.
+"""
+import sys
+
+REPLAY_OUTPUT = 0
+REPLAY_FEATURE = 1
+
+
+def records(lines, device):
+	start = None
+	for line in lines:
+		fields = line.split()
+		if len(fields) < 6 or fields[2] != 'S' or '=' not in fields:
+			continue
+		kind, _, dev, _ = fields[3].split(':')
+		if int(dev) != device:
+			continue
+		if kind == 'Io':
+			rtype = REPLAY_OUTPUT
+		elif kind == 'Co' and fields[4] == 's' and fields[5:7] == ['21', '09']:
+			report_type = int(fields[7], 16) >> 8
+			if report_type == 2:
+				rtype = REPLAY_OUTPUT
+			elif report_type == 3:
+				rtype = REPLAY_FEATURE
+			else:
+				continue
+		else:
+			continue
+		data = bytes.fromhex(''.join(fields[fields.index('=') + 1:]))
+		if not data or len(data) > 64:
+			continue
+		time = int(fields[1])
+		if start is None:
+			start = time
+		yield (time - start) // 1000, rtype, data
+
+
+def main():
+	if len(sys.argv) != 3:
+		sys.exit(__doc__)
+	with open(sys.argv[1]) as f:
+		recs = list(records(f, int(sys.argv[2])))
+	print('// Captured PID traffic for the FFBReplay example, see capture.h in')
+	print('// examples/FFBReplay for the record format.')
+	print()
+	print('#define REPLAY_OUTPUT  %d' % REPLAY_OUTPUT)
+	print('#define REPLAY_FEATURE %d' % REPLAY_FEATURE)
+	print()
+	print('const uint8_t capture[] PROGMEM = {')
+	for time, rtype, data in recs:
+		head = list(time.to_bytes(4, 'little')) + [rtype, len(data)]
+		print('\t' + ', '.join('0x%02X' % b for b in head) + ',')
+		print('\t  ' + ', '.join('0x%02X' % b for b in data) + ',')
+	print('};')
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,160 @@
+/*
+  AxisSampler.cpp
+
+  Interrupt driven analog sampling for a Joystick_'s axes.
+*/
+
+#include "AxisSampler.h"
+
+#if defined(_USING_DYNAMIC_HID)
+
+AxisSampler::AxisSampler(uint8_t hysteresis)
+{
+	_hysteresis = hysteresis;
+}
+
+bool AxisSampler::addAxis(uint8_t pin, uint8_t axis)
+{
+	if (_channelCount >= AXIS_SAMPLER_MAX_CHANNELS || axis > AXIS_SAMPLER_STEERING)
+		return false;
+
+	_pins[_channelCount] = pin;
+	_axes[_channelCount] = axis;
+#if defined(__AVR__)
+	// Same pin to channel mapping as analogRead()
+#if defined(__AVR_ATmega32U4__)
+	if (pin >= 18) pin -= 18;
+	pin = analogPinToChannel(pin);
+#else
+	if (pin >= A0) pin -= A0;
+#endif
+	_mux[_channelCount] = pin;
+#endif
+	_channelCount++;
+	return true;
+}
+
+int16_t* AxisSampler::axisField(Joystick_& joystick, uint8_t axis)
+{
+	switch (axis)
+	{
+		case AXIS_SAMPLER_X: return &joystick._xAxis;
+		case AXIS_SAMPLER_Y: return &joystick._yAxis;
+		case AXIS_SAMPLER_Z: return &joystick._zAxis;
+		case AXIS_SAMPLER_RX: return &joystick._xAxisRotation;
+		case AXIS_SAMPLER_RY: return &joystick._yAxisRotation;
+		case AXIS_SAMPLER_RZ: return &joystick._zAxisRotation;
+		case AXIS_SAMPLER_RUDDER: return &joystick._rudder;
+		case AXIS_SAMPLER_THROTTLE: return &joystick._throttle;
+		case AXIS_SAMPLER_ACCELERATOR: return &joystick._accelerator;
+		case AXIS_SAMPLER_BRAKE: return &joystick._brake;
+		default: return &joystick._steering;
+	}
+}
+
+#if defined(__AVR__)
+
+AxisSampler* AxisSampler::active = NULL;
+
+void AxisSampler::startConversion(uint8_t mux)
+{
+#if defined(ADCSRB) && defined(MUX5)
+	ADCSRB = (ADCSRB & ~(1 << MUX5)) | (((mux >> 3) & 0x01) << MUX5);
+#endif
+	ADMUX = _reference | (mux & 0x07);
+	ADCSRA |= _BV(ADSC);
+}
+
+void AxisSampler::begin()
+{
+	if (_channelCount == 0)
+		return;
+	// Let analogRead() program the reference chosen with analogReference()
+	analogRead(_pins[0]);
+	_reference = ADMUX & (_BV(REFS1) | _BV(REFS0));
+	for (uint8_t i = 0; i < _channelCount; i++)
+		_sum[i] = 0;
+	_current = 0;
+	_round = 0;
+	_ready = 0;
+	active = this;
+	// ADC on, interrupt on completion, clock / 128 as analogRead() uses at 16 MHz
+	ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	startConversion(_mux[0]);
+}
+
+void AxisSampler::end()
+{
+	ADCSRA &= ~_BV(ADIE);
+	active = NULL;
+}
+
+void AxisSampler::conversionComplete()
+{
+	_sum[_current] += ADC;
+	if (++_current >= _channelCount)
+	{
+		_current = 0;
+		if (++_round >= (1 << AXIS_SAMPLER_OVERSAMPLE_SHIFT))
+		{
+			// Decimate: one averaged value per pin
+			for (uint8_t i = 0; i < _channelCount; i++)
+			{
+				_values[i] = _sum[i] >> AXIS_SAMPLER_OVERSAMPLE_SHIFT;
+				_sum[i] = 0;
+			}
+			_round = 0;
+			_ready = (1 << _channelCount) - 1;
+		}
+	}
+	startConversion(_mux[_current]);
+}
+
+#else
+
+void AxisSampler::begin()
+{
+}
+
+void AxisSampler::end()
+{
+}
+
+#endif
+
+bool AxisSampler::update(Joystick_& joystick)
+{
+	int16_t values[AXIS_SAMPLER_MAX_CHANNELS];
+#if defined(__AVR__)
+	noInterrupts();
+	uint8_t ready = _ready;
+	_ready = 0;
+	for (uint8_t i = 0; i < _channelCount; i++)
+		values[i] = _values[i];
+	interrupts();
+#else
+	uint8_t ready = (1 << _channelCount) - 1;
+	for (uint8_t i = 0; i < _channelCount; i++)
+		values[i] = analogRead(_pins[i]);
+#endif
+
+	bool changed = false;
+	for (uint8_t i = 0; i < _channelCount; i++)
+	{
+		if (!(ready & (1 << i)))
+			continue;
+		int16_t delta = values[i] - _reported[i];
+		if ((_reportedMask & (1 << i)) && abs(delta) <= _hysteresis)
+			continue;
+		_reported[i] = values[i];
+		_reportedMask |= 1 << i;
+		*axisField(joystick, _axes[i]) = values[i];
+		changed = true;
+	}
+
+	if (changed && joystick._autoSendState) joystick.sendState();
+	else DynamicHID().SendIdleReports();
+	return changed;
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+  AxisSampler.h
+
+  Interrupt driven analog sampling for a Joystick_'s axes.
+
+  On AVR the ADC interrupt converts the configured pins round robin and
+  sums 2^AXIS_SAMPLER_OVERSAMPLE_SHIFT conversions per pin, so loop()
+  never waits for a conversion. update() moves the averaged values into
+  the joystick, skipping changes not larger than the hysteresis, and
+  sends one report if anything moved. Values are on analogRead()'s
+  0..1023 scale. Other boards fall back to analogRead() in update().
+
+  On AVR the sketch hands the ADC interrupt to the sampler by writing
+  AXIS_SAMPLER_ISR once, at file scope, so sketches that do not use the
+  sampler keep the ADC vector free. The sampler converts against the
+  reference set with analogReference().
+
+  Do not call analogRead() while the sampler is running.
+*/
+
+#ifndef AXIS_SAMPLER_h
+#define AXIS_SAMPLER_h
+
+#include "Joystick.h"
+
+#define AXIS_SAMPLER_MAX_CHANNELS 8
+// 2^shift conversions are averaged per value, at most 6 so a sum fits 16 bits
+#ifndef AXIS_SAMPLER_OVERSAMPLE_SHIFT
+#define AXIS_SAMPLER_OVERSAMPLE_SHIFT 4
+#endif
+#if AXIS_SAMPLER_OVERSAMPLE_SHIFT > 6
+#error AXIS_SAMPLER_OVERSAMPLE_SHIFT must be at most 6
+#endif
+
+// Axes an analog pin can drive
+#define AXIS_SAMPLER_X           0
+#define AXIS_SAMPLER_Y           1
+#define AXIS_SAMPLER_Z           2
+#define AXIS_SAMPLER_RX          3
+#define AXIS_SAMPLER_RY          4
+#define AXIS_SAMPLER_RZ          5
+#define AXIS_SAMPLER_RUDDER      6
+#define AXIS_SAMPLER_THROTTLE    7
+#define AXIS_SAMPLER_ACCELERATOR 8
+#define AXIS_SAMPLER_BRAKE       9
+#define AXIS_SAMPLER_STEERING   10
+
+class AxisSampler
+{
+private:
+	uint8_t _channelCount = 0;
+	uint8_t _pins[AXIS_SAMPLER_MAX_CHANNELS];
+	uint8_t _axes[AXIS_SAMPLER_MAX_CHANNELS];
+	uint8_t _hysteresis;
+	int16_t _reported[AXIS_SAMPLER_MAX_CHANNELS];
+	uint8_t _reportedMask = 0;
+
+#if defined(__AVR__)
+	uint8_t _mux[AXIS_SAMPLER_MAX_CHANNELS];
+	// REFS bits of ADMUX, as analogRead() programmed them
+	uint8_t _reference = 0;
+	// ISR state
+	volatile uint8_t _current = 0;
+	volatile uint8_t _round = 0;
+	volatile uint16_t _sum[AXIS_SAMPLER_MAX_CHANNELS];
+	volatile uint16_t _values[AXIS_SAMPLER_MAX_CHANNELS];
+	volatile uint8_t _ready = 0;
+
+	void startConversion(uint8_t mux);
+#endif
+
+	static int16_t* axisField(Joystick_& joystick, uint8_t axis);
+
+public:
+	AxisSampler(uint8_t hysteresis = 2);
+
+	// Maps an analog pin (e.g. A0) to one of the AXIS_SAMPLER_* axes, call before begin()
+	bool addAxis(uint8_t pin, uint8_t axis);
+	void setHysteresis(uint8_t hysteresis) { _hysteresis = hysteresis; }
+	// Last value update() passed on for the axis added as number channel
+	int16_t getValue(uint8_t channel) { return _reported[channel]; }
+
+	void begin();
+	void end();
+
+	// Copies new values that moved more than the hysteresis into joystick.
+	// Returns true if an axis changed, the report is then sent when joystick auto sends.
+	bool update(Joystick_& joystick);
+
+#if defined(__AVR__)
+	// Called from the ADC interrupt
+	void conversionComplete();
+	static AxisSampler* active;
+#endif
+};
+
+#if defined(__AVR__)
+// Defines the ADC interrupt for the running sampler, write it once in the sketch
+#define AXIS_SAMPLER_ISR \
+	ISR(ADC_vect) \
+	{ \
+		if (AxisSampler::active) \
+			AxisSampler::active->conversionComplete(); \
+	}
+#else
+#define AXIS_SAMPLER_ISR
+#endif
+
+#endif
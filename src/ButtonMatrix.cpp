@@ -0,0 +1,86 @@
+/*
+  ButtonMatrix.cpp
+
+  Debounced button matrix scanner that feeds a Joystick_'s buttons.
+*/
+
+#include "ButtonMatrix.h"
+
+#if defined(_USING_DYNAMIC_HID)
+
+ButtonMatrix::ButtonMatrix(const uint8_t* rowPins, uint8_t rowCount, const uint8_t* columnPins, uint8_t columnCount)
+{
+	if (columnCount > BUTTON_MATRIX_MAX_COLUMNS) columnCount = BUTTON_MATRIX_MAX_COLUMNS;
+	uint16_t buttonCount = (uint16_t)rowCount * columnCount;
+	if (buttonCount > BUTTON_MATRIX_MAX_BUTTONS) buttonCount = BUTTON_MATRIX_MAX_BUTTONS;
+
+	_rowPins = rowPins;
+	_rowCount = rowCount;
+	_columnPins = columnPins;
+	_columnCount = columnCount;
+	_buttonCount = buttonCount;
+	memset(_state, 0, sizeof(_state));
+	memset(_count0, 0, sizeof(_count0));
+	memset(_count1, 0, sizeof(_count1));
+}
+
+void ButtonMatrix::begin()
+{
+	for (uint8_t row = 0; row < _rowCount; row++)
+	{
+		pinMode(_rowPins[row], OUTPUT);
+		digitalWrite(_rowPins[row], HIGH);
+	}
+	for (uint8_t column = 0; column < _columnCount; column++)
+	{
+		pinMode(_columnPins[column], INPUT_PULLUP);
+		_columnPorts[column] = (ButtonMatrixPort)portInputRegister(digitalPinToPort(_columnPins[column]));
+		_columnMasks[column] = digitalPinToBitMask(_columnPins[column]);
+	}
+}
+
+bool ButtonMatrix::scan(Joystick_& joystick)
+{
+	uint8_t sample[BUTTON_MATRIX_MAX_BYTES];
+	memset(sample, 0, sizeof(sample));
+
+	uint8_t button = 0;
+	for (uint8_t row = 0; row < _rowCount && button < _buttonCount; row++)
+	{
+		digitalWrite(_rowPins[row], LOW);
+		delayMicroseconds(BUTTON_MATRIX_SETTLE_US);
+		for (uint8_t column = 0; column < _columnCount && button < _buttonCount; column++, button++)
+		{
+			// A pressed button pulls its column LOW
+			if (!(*_columnPorts[column] & _columnMasks[column]))
+				sample[button / 8] |= 1 << (button % 8);
+		}
+		digitalWrite(_rowPins[row], HIGH);
+	}
+
+	uint8_t bytes = (_buttonCount + 7) / 8;
+	if (bytes > joystick._buttonValuesArraySize) bytes = joystick._buttonValuesArraySize;
+
+	bool changed = false;
+	for (uint8_t index = 0; index < bytes; index++)
+	{
+		// 2 bit vertical counters: a button toggles once it has differed from
+		// its debounced state for BUTTON_MATRIX_DEBOUNCE_SCANS scans in a row.
+		uint8_t delta = sample[index] ^ _state[index];
+		_count1[index] = (_count1[index] ^ _count0[index]) & delta;
+		_count0[index] = ~_count0[index] & delta;
+		uint8_t toggle = delta & ~(_count0[index] | _count1[index]);
+		if (toggle)
+		{
+			_state[index] ^= toggle;
+			joystick._buttonValues[index] = (joystick._buttonValues[index] & ~toggle) | (_state[index] & toggle);
+			changed = true;
+		}
+	}
+
+	if (changed && joystick._autoSendState) joystick.sendState();
+	else DynamicHID().SendIdleReports();
+	return changed;
+}
+
+#endif
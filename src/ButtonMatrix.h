@@ -0,0 +1,66 @@
+/*
+  ButtonMatrix.h
+
+  Debounced button matrix scanner that feeds a Joystick_'s buttons.
+
+  Rows are driven LOW one at a time, columns are read with INPUT_PULLUP
+  straight from their port input registers. Each button is debounced by
+  a 2 bit vertical counter, 8 buttons per byte, so a change is accepted
+  after BUTTON_MATRIX_DEBOUNCE_SCANS identical scans.
+  Button n of the joystick is row n / columnCount, column n % columnCount.
+*/
+
+#ifndef BUTTON_MATRIX_h
+#define BUTTON_MATRIX_h
+
+#include "Joystick.h"
+
+#ifndef BUTTON_MATRIX_MAX_BUTTONS
+#define BUTTON_MATRIX_MAX_BUTTONS 128
+#endif
+#define BUTTON_MATRIX_MAX_BYTES ((BUTTON_MATRIX_MAX_BUTTONS + 7) / 8)
+#define BUTTON_MATRIX_MAX_COLUMNS 16
+#define BUTTON_MATRIX_DEBOUNCE_SCANS 4
+// Time for the columns to follow a newly driven row, in us
+#ifndef BUTTON_MATRIX_SETTLE_US
+#define BUTTON_MATRIX_SETTLE_US 2
+#endif
+
+#ifdef __AVR__
+typedef volatile uint8_t* ButtonMatrixPort;
+typedef uint8_t ButtonMatrixMask;
+#else
+typedef volatile uint32_t* ButtonMatrixPort;
+typedef uint32_t ButtonMatrixMask;
+#endif
+
+class ButtonMatrix
+{
+private:
+	const uint8_t* _rowPins;
+	const uint8_t* _columnPins;
+	uint8_t _rowCount;
+	uint8_t _columnCount;
+	uint8_t _buttonCount;
+
+	// Column input registers and bit masks, looked up once in begin()
+	ButtonMatrixPort _columnPorts[BUTTON_MATRIX_MAX_COLUMNS];
+	ButtonMatrixMask _columnMasks[BUTTON_MATRIX_MAX_COLUMNS];
+
+	// Debounced state and vertical counters, bit per button
+	uint8_t _state[BUTTON_MATRIX_MAX_BYTES];
+	uint8_t _count0[BUTTON_MATRIX_MAX_BYTES];
+	uint8_t _count1[BUTTON_MATRIX_MAX_BYTES];
+
+public:
+	ButtonMatrix(const uint8_t* rowPins, uint8_t rowCount, const uint8_t* columnPins, uint8_t columnCount);
+
+	void begin();
+
+	// Scans every row once and copies debounced changes into joystick's
+	// buttons. Returns true if a button changed, in which case the report
+	// is sent when joystick auto sends.
+	bool scan(Joystick_& joystick);
+};
+
+#endif
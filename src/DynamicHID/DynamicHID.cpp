@@ -26,6 +26,7 @@
 #ifdef _VARIANT_ARDUINO_DUE_X_
 #define USB_SendControl USBD_SendControl
 #define USB_Send USBD_Send
+#define USB_SendSpace USBD_SendSpace
 #endif
 
 DynamicHID_& DynamicHID()
@@ -46,6 +47,24 @@ int DynamicHID_::getInterface(uint8_t* interfaceCount)
 	return USB_SendControl(0, &hidInterface, sizeof(hidInterface));
 }
 
+// Moves the REPORT_ID items in a chunk of the PID descriptor into a device's
+// report ID range. The item parser state carries over between chunks.
+static void OffsetReportIds(uint8_t* data, uint8_t length, uint8_t base, uint8_t& itemRemaining, bool& isReportId)
+{
+	static const uint8_t itemDataSize[4] = { 0, 1, 2, 4 };
+	for (uint8_t i = 0; i < length; i++) {
+		if (itemRemaining == 0) {
+			itemRemaining = itemDataSize[data[i] & 0x03];
+			isReportId = (data[i] == 0x85);
+		} else {
+			if (isReportId) {
+				data[i] += base;
+			}
+			itemRemaining--;
+		}
+	}
+}
+
 int DynamicHID_::getDescriptor(USBSetup& setup)
 {
 	// Check if this is a HID Class Descriptor request
@@ -54,17 +73,47 @@ int DynamicHID_::getDescriptor(USBSetup& setup)
 	// In a HID Class Descriptor wIndex cointains the interface number
 	if (setup.wIndex != pluggedInterface) { return 0; }
 
+	// Stream the joystick and PID descriptors of every node as one sequence,
+	// one control packet per USB_SendControl call, and stop as soon as the
+	// host has the number of bytes it asked for.
+	uint16_t length = min(setup.wLength, descriptorSize);
+	uint8_t packet[USB_EP_SIZE];
+	uint8_t count = 0;
+	uint16_t queued = 0;
 	int total = 0;
 	DynamicHIDSubDescriptor* node;
-	for (node = rootNode; node; node = node->next) {
-		int res = USB_SendControl(0, node->data, node->length);
-		if (res == -1)
-			return -1;
-		total += res;
-		res = USB_SendControl(TRANSFER_PGM, node->pid_data, node->pid_length);
-		if (res == -1)
-			return -1;
-		total += res;
+	for (node = rootNode; node && queued < length; node = node->next) {
+		for (uint8_t part = 0; part < 2; part++) {
+			const uint8_t* src = (const uint8_t*)(part == 0 ? node->data : node->pid_data);
+			uint16_t srcLength = part == 0 ? node->length : node->pid_length;
+			bool inProgMem = part == 0 ? node->inProgMem : true;
+			bool offsetIds = part == 1 && node->pidReportIdBase != 0;
+			uint8_t itemRemaining = 0;
+			bool isReportId = false;
+			uint16_t offset = 0;
+			while (offset < srcLength && queued < length) {
+				uint16_t n = min((uint16_t)(sizeof(packet) - count), (uint16_t)(srcLength - offset));
+				n = min(n, (uint16_t)(length - queued));
+				if (inProgMem) {
+					memcpy_P(&packet[count], src + offset, n);
+				} else {
+					memcpy(&packet[count], src + offset, n);
+				}
+				if (offsetIds) {
+					OffsetReportIds(&packet[count], n, node->pidReportIdBase, itemRemaining, isReportId);
+				}
+				count += n;
+				offset += n;
+				queued += n;
+				if (count == sizeof(packet) || queued == length) {
+					int res = USB_SendControl(0, packet, count);
+					if (res == -1)
+						return -1;
+					total += res;
+					count = 0;
+				}
+			}
+		}
 	}
 	
 	// Reset the protocol on reenumeration. Normally the host should not assume the state of the protocol
@@ -89,26 +138,107 @@ void DynamicHID_::AppendDescriptor(DynamicHIDSubDescriptor *node)
 	if (!rootNode) {
 		rootNode = node;
 	} else {
-		DynamicHIDSubDescriptor *current = rootNode;
-		while (current->next) {
-			current = current->next;
-		}
-		current->next = node;
+		tailNode->next = node;
 	}
+	tailNode = node;
 	descriptorSize += node->length;
 	descriptorSize += node->pid_length;
 }
 
+// The PID descriptor closes the application collection of the device, so
+// its END_COLLECTION stays in the descriptor.
+void DynamicHID_::RemovePIDReports(DynamicHIDSubDescriptor *node)
+{
+	static const uint8_t endCollection[] PROGMEM = {0xC0};
+	descriptorSize -= node->pid_length - sizeof(endCollection);
+	node->pid_data = endCollection;
+	node->pid_length = sizeof(endCollection);
+	node->pidReportHandler = NULL;
+	node->pidReportIdBase = 0;
+}
+
+PIDReportHandler* DynamicHID_::findPIDReportHandler(uint8_t reportId, uint8_t* pidReportId)
+{
+	for (DynamicHIDSubDescriptor* node = rootNode; node; node = node->next) {
+		if (node->pidReportHandler &&
+			reportId > node->pidReportIdBase &&
+			reportId <= node->pidReportIdBase + PID_REPORT_ID_COUNT) {
+			*pidReportId = reportId - node->pidReportIdBase;
+			return node->pidReportHandler;
+		}
+	}
+	return NULL;
+}
+
+bool DynamicHID_::reportIdsFree(uint8_t first, uint8_t last)
+{
+	for (DynamicHIDSubDescriptor* node = rootNode; node; node = node->next) {
+		if (node->inputReport && node->inputReport[0] >= first && node->inputReport[0] <= last) {
+			return false;
+		}
+		if (node->pidReportHandler &&
+			first <= node->pidReportIdBase + PID_REPORT_ID_COUNT &&
+			last > node->pidReportIdBase) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int DynamicHID_::sendIn(const void* data, int len)
+{
+	if (transport) {
+		return transport->send(data, len);
+	}
+	return USB_Send(PID_ENDPOINT_IN | TRANSFER_RELEASE, data, len);
+}
+
 int DynamicHID_::SendReport(uint8_t id, const void* data, int len)
 {
 	uint8_t p[len + 1];
 	p[0] = id;
 	memcpy(&p[1], data, len);
-	return USB_Send(PID_ENDPOINT_IN | TRANSFER_RELEASE, p, len + 1);
+	return sendIn(p, len + 1);
+}
+
+DynamicHIDSubDescriptor* DynamicHID_::findInputReport(uint8_t reportId)
+{
+	for (DynamicHIDSubDescriptor* node = rootNode; node; node = node->next) {
+		if (node->inputReport && node->inputReport[0] == reportId) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+// Sends the node's cached input report as is and restarts its idle period.
+int DynamicHID_::SendReport(DynamicHIDSubDescriptor* node)
+{
+	node->lastSent = millis();
+	return sendIn(node->inputReport, node->inputReportLength);
+}
+
+// Repeats every cached input report whose idle period has run out, as the
+// host asked for with SET_IDLE. Never waits for the IN endpoint.
+void DynamicHID_::SendIdleReports()
+{
+	unsigned long now = millis();
+	for (DynamicHIDSubDescriptor* node = rootNode; node; node = node->next) {
+		if (!node->inputReport || node->idleRate == 0)
+			continue;
+		if (now - node->lastSent < node->idleRate * 4UL)
+			continue;
+		if (!usb_CanSend(node->inputReportLength - 1))
+			return;
+		SendReport(node);
+	}
 }
 
 int DynamicHID_::RecvData(byte* data)
 {
+	if (transport) {
+		return max(transport->recv(data, USB_EP_SIZE), 0);
+	}
 	int count = 0;
 	while (usb_Available()) {
 		data[count++] = (byte)USB_Recv(PID_ENDPOINT_OUT);
@@ -120,11 +250,17 @@ void DynamicHID_::RecvfromUsb()
 {
 	if (usb_Available() > 0) {
 		uint8_t out_ffbdata[64];
-		uint16_t len = USB_Recv(PID_ENDPOINT_OUT, &out_ffbdata, 64);
-		if (len >= 0) {
-			pidReportHandler.UppackUsbData(out_ffbdata, len);
+		FFB_PROFILE_BEGIN(start);
+		int len = transport ? transport->recv(out_ffbdata, 64) : USB_Recv(PID_ENDPOINT_OUT, &out_ffbdata, 64);
+		FFB_PROFILE_END(FFB_STAGE_USB_RECV, start);
+		if (len > 0) {
+			PIDReportHandler* handler = findPIDReportHandler(out_ffbdata[0], &out_ffbdata[0]);
+			if (handler) {
+				handler->UppackUsbData(out_ffbdata, len);
+			}
 		}
 	}
+	SendIdleReports();
 }
 
 bool DynamicHID_::GetReport(USBSetup& setup) {
@@ -132,21 +268,32 @@ bool DynamicHID_::GetReport(USBSetup& setup) {
 	uint8_t report_type = setup.wValueH;
 	if (report_type == DYNAMIC_HID_REPORT_TYPE_INPUT)
 	{
-		//        /* Create the next HID report to send to the host */
-		//        GetNextReport(0xFF, &JoystickReportData);
-		//        /* Write the report data to the control endpoint */
-		//        USB_SendControl(TRANSFER_RELEASE, &JoystickReportData, sizeof(JoystickReportData));
+		// Answer with the report last sent on the IN endpoint, nothing is rebuilt
+		DynamicHIDSubDescriptor* node = findInputReport(report_id);
+		if (!node) {
+			return (false);
+		}
+		USB_SendControl(TRANSFER_RELEASE, node->inputReport, min((uint16_t)node->inputReportLength, setup.wLength));
+		return (true);
 	}
 	if (report_type == DYNAMIC_HID_REPORT_TYPE_OUTPUT) {}
 	if (report_type == DYNAMIC_HID_REPORT_TYPE_FEATURE) {
-		if ((report_id == 6))// && (gNewEffectBlockLoad.reportId==6))
+		uint8_t pid_report_id;
+		PIDReportHandler* handler = findPIDReportHandler(report_id, &pid_report_id);
+		if (!handler) {
+			return (false);
+		}
+		if ((pid_report_id == 6))// && (gNewEffectBlockLoad.reportId==6))
 		{
 			_delay_us(500);
-			USB_SendControl(TRANSFER_RELEASE, pidReportHandler.getPIDBlockLoad(), sizeof(USB_FFBReport_PIDBlockLoad_Feature_Data_t));
-			pidReportHandler.pidBlockLoad.reportId = 0;
+			USB_FFBReport_PIDBlockLoad_Feature_Data_t ans;
+			memcpy(&ans, handler->getPIDBlockLoad(), sizeof(USB_FFBReport_PIDBlockLoad_Feature_Data_t));
+			ans.reportId = report_id;
+			USB_SendControl(TRANSFER_RELEASE, &ans, sizeof(USB_FFBReport_PIDBlockLoad_Feature_Data_t));
+			handler->pidBlockLoad.reportId = 0;
 			return (true);
 		}
-		if (report_id == 7)
+		if (pid_report_id == 7)
 		{
 			USB_FFBReport_PIDPool_Feature_Data_t ans;
 			ans.reportId = report_id;
@@ -156,6 +303,16 @@ bool DynamicHID_::GetReport(USBSetup& setup) {
 			USB_SendControl(TRANSFER_RELEASE, &ans, sizeof(USB_FFBReport_PIDPool_Feature_Data_t));
 			return (true);
 		}
+#if FFB_PROFILE
+		if (pid_report_id == FFB_PROFILE_REPORT_ID)
+		{
+			FFBProfile_Feature_Data_t ans;
+			ffbProfileReport(&ans, ffbProfileSelectedStage);
+			ans.reportId = report_id;
+			USB_SendControl(TRANSFER_RELEASE, &ans, sizeof(FFBProfile_Feature_Data_t));
+			return (true);
+		}
+#endif
 	}
 	return (false);
 }
@@ -173,12 +330,26 @@ bool DynamicHID_::SetReport(USBSetup& setup) {
 			//disableFeatureReport();
 			return true;
 		}
-		if (report_id == 5)
+		uint8_t pid_report_id;
+		PIDReportHandler* handler = findPIDReportHandler(report_id, &pid_report_id);
+		if (handler && pid_report_id == 5)
 		{
 			USB_FFBReport_CreateNewEffect_Feature_Data_t ans;
 			USB_RecvControl(&ans, sizeof(USB_FFBReport_CreateNewEffect_Feature_Data_t));
-			pidReportHandler.CreateNewEffect(&ans);
+			ans.reportId = pid_report_id;
+			handler->CreateNewEffect(&ans);
+		}
+#if FFB_PROFILE
+		else if (handler && pid_report_id == FFB_PROFILE_REPORT_ID)
+		{
+			uint8_t select[2];	// report ID, stage
+			USB_RecvControl(&select, sizeof(select));
+			if (select[1] == 0xFF)
+				ffbProfileResetPending = 1;
+			else
+				ffbProfileSelectedStage = select[1];
 		}
+#endif
 		return (true);
 	}
 	if (setup.wValueH == DYNAMIC_HID_REPORT_TYPE_INPUT)
@@ -212,7 +383,10 @@ bool DynamicHID_::setup(USBSetup& setup)
 			return true;
 		}
 		if (request == DYNAMIC_HID_GET_IDLE) {
-			// TODO: Send8(idle);
+			DynamicHIDSubDescriptor* node = findInputReport(setup.wValueL);
+			uint8_t rate = (setup.wValueL == 0 || !node) ? idle : node->idleRate;
+			USB_SendControl(0, &rate, 1);
+			return true;
 		}
 	}
 
@@ -225,7 +399,16 @@ bool DynamicHID_::setup(USBSetup& setup)
 			return true;
 		}
 		if (request == DYNAMIC_HID_SET_IDLE) {
-			idle = setup.wValueL;
+			// Duration in wValueH, report ID in wValueL where 0 means every report
+			if (setup.wValueL == 0) {
+				idle = setup.wValueH;
+			}
+			for (DynamicHIDSubDescriptor* node = rootNode; node; node = node->next) {
+				if (setup.wValueL == 0 || (node->inputReport && node->inputReport[0] == setup.wValueL)) {
+					node->idleRate = setup.wValueH;
+					node->lastSent = millis();
+				}
+			}
 			return true;
 		}
 		if (request == DYNAMIC_HID_SET_REPORT)
@@ -238,8 +421,8 @@ bool DynamicHID_::setup(USBSetup& setup)
 }
 
 DynamicHID_::DynamicHID_(void) : PluggableUSBModule(PID_ENPOINT_COUNT, 1, epType),
-                   rootNode(NULL), descriptorSize(0),
-                   protocol(DYNAMIC_HID_REPORT_PROTOCOL), idle(1)
+                   rootNode(NULL), tailNode(NULL), descriptorSize(0), transport(NULL),
+                   protocol(DYNAMIC_HID_REPORT_PROTOCOL), idle(0)
 {
 	epType[0] = EP_TYPE_INTERRUPT_IN;
 	epType[1] = EP_TYPE_INTERRUPT_OUT;
@@ -252,7 +435,19 @@ int DynamicHID_::begin(void)
 }
 
 bool DynamicHID_::usb_Available() {
+	if (transport) {
+		return transport->available() > 0;
+	}
 	return USB_Available(PID_ENDPOINT_OUT);
 }
 
+// True if a report of len bytes (plus its report ID) fits the IN endpoint
+// without waiting for the host to collect the previous one.
+bool DynamicHID_::usb_CanSend(int len) {
+	if (transport) {
+		return transport->sendSpace() >= len + 1;
+	}
+	return USB_SendSpace(PID_ENDPOINT_IN) >= len + 1;
+}
+
 #endif /* if defined(USBCON) */
@@ -101,16 +101,45 @@ typedef struct
   EndpointDescriptor  out;
 } DYNAMIC_HIDDescriptor;
 
+// Carries the interrupt endpoint traffic, every report with its report ID
+// first. DynamicHID_ uses its plugged USB endpoints until setTransport()
+// hands it another one, e.g. an in-memory loopback for testing. Control
+// requests (descriptors, GET_REPORT, SET_REPORT) always stay on USB.
+class DynamicHIDTransport {
+public:
+  // Queues one IN report, returns the number of bytes taken or -1
+  virtual int send(const void* data, int len) = 0;
+  // Bytes send() would take right now without waiting
+  virtual int sendSpace() = 0;
+  // Length of the next OUT report, 0 if none is waiting
+  virtual int available() = 0;
+  // Reads the next OUT report, returns its length or -1
+  virtual int recv(void* data, int len) = 0;
+};
+
 class DynamicHIDSubDescriptor {
 public:
   DynamicHIDSubDescriptor *next = NULL;
-  DynamicHIDSubDescriptor(const void *d, const uint16_t l, const void* pid_d, const uint16_t pid_l, const bool ipm = true) : data(d), length(l),pid_data(pid_d), pid_length(pid_l), inProgMem(ipm) { }
+  DynamicHIDSubDescriptor(const void *d, const uint16_t l, const void* pid_d, const uint16_t pid_l, const bool ipm = true,
+                          PIDReportHandler* pid_h = NULL, const uint8_t pid_base = 0) :
+    data(d), length(l),pid_data(pid_d), pid_length(pid_l), inProgMem(ipm), pidReportHandler(pid_h), pidReportIdBase(pid_base) { }
 
   const void* data;
   const void* pid_data;
   const uint16_t length;
-  const uint16_t pid_length;
+  uint16_t pid_length;
   const bool inProgMem;
+  // PID reports of this device use report IDs pidReportIdBase + 1..PID_REPORT_ID_COUNT
+  // and are routed to pidReportHandler. RemovePIDReports() clears both.
+  PIDReportHandler* pidReportHandler;
+  uint8_t pidReportIdBase;
+
+  // Last input report sent for this device, report ID first. GET_REPORT(Input)
+  // is answered from it and it is sent again when the idle period runs out.
+  uint8_t* inputReport = NULL;
+  uint8_t inputReportLength = 0; // including the report ID
+  uint8_t idleRate = 0;          // 4 ms units, 0 only sends on change
+  unsigned long lastSent = 0;
 };
 
 class DynamicHID_ : public PluggableUSBModule
@@ -119,11 +148,22 @@ public:
   DynamicHID_(void);
   int begin(void);
   bool usb_Available();
+  bool usb_CanSend(int len);
   int SendReport(uint8_t id, const void* data, int len);
+  int SendReport(DynamicHIDSubDescriptor* node);
+  void SendIdleReports();
   int RecvData(byte* data);
   void RecvfromUsb();
   void AppendDescriptor(DynamicHIDSubDescriptor* node);
-  PIDReportHandler pidReportHandler;
+  // Takes the PID reports out of a registered node, its report IDs are free then
+  void RemovePIDReports(DynamicHIDSubDescriptor* node);
+  PIDReportHandler* findPIDReportHandler(uint8_t reportId, uint8_t* pidReportId);
+  // True when no registered device uses a report ID in first..last, either for
+  // its input report or in its PID report range
+  bool reportIdsFree(uint8_t first, uint8_t last);
+  DynamicHIDSubDescriptor* findInputReport(uint8_t reportId);
+  // NULL (the default) goes back to the USB endpoints
+  void setTransport(DynamicHIDTransport* t) { transport = t; }
 
 protected:
   // Implementation of the PluggableUSBModule
@@ -138,10 +178,14 @@ private:
   uint8_t epType[2];
 
   DynamicHIDSubDescriptor* rootNode;
+  DynamicHIDSubDescriptor* tailNode;
   uint16_t descriptorSize;
 
+  DynamicHIDTransport* transport;
+  int sendIn(const void* data, int len);
+
   uint8_t protocol;
-  uint8_t idle;
+  uint8_t idle;   // idle rate set for all reports (report ID 0)
 };
 
 // Replacement for global singleton.
@@ -0,0 +1,68 @@
+#include "FFBProfile.h"
+
+#if FFB_PROFILE
+
+FFBStageStats ffbProfileStats[FFB_PROFILE_STAGE_COUNT];
+uint8_t ffbProfileSelectedStage = 0;
+volatile uint8_t ffbProfileResetPending = 0;
+
+static const FFBStageStats ffbProfileNoStats = {};
+
+void ffbProfileRecord(uint8_t stage, unsigned long us)
+{
+	if (ffbProfileResetPending)
+		ffbProfileReset();
+	if (stage >= FFB_PROFILE_STAGE_COUNT)
+		return;
+	FFBStageStats& stats = ffbProfileStats[stage];
+	uint16_t time = us > 0xFFFF ? 0xFFFF : us;
+
+	uint8_t bucket = 0;
+	for (uint16_t limit = time >> 3; limit && bucket < FFB_PROFILE_BUCKETS - 1; limit >>= 1)
+		bucket++;
+
+	// The feature report may read the stats from the USB interrupt
+	noInterrupts();
+	if (stats.count == 0 || time < stats.min)
+		stats.min = time;
+	if (time > stats.max)
+		stats.max = time;
+	stats.count++;
+	stats.total += time;
+	if (stats.buckets[bucket] != 0xFFFF)
+		stats.buckets[bucket]++;
+	interrupts();
+}
+
+void ffbProfileReset()
+{
+	noInterrupts();
+	memset(ffbProfileStats, 0, sizeof(ffbProfileStats));
+	ffbProfileResetPending = 0;
+	interrupts();
+}
+
+const FFBStageStats& ffbProfileStage(uint8_t stage)
+{
+	if (ffbProfileResetPending)
+		ffbProfileReset();
+	if (stage >= FFB_PROFILE_STAGE_COUNT)
+		return ffbProfileNoStats;
+	return ffbProfileStats[stage];
+}
+
+void ffbProfileReport(FFBProfile_Feature_Data_t* report, uint8_t stage)
+{
+	memset(report, 0, sizeof(FFBProfile_Feature_Data_t));
+	report->stage = stage;
+	if (stage >= FFB_PROFILE_STAGE_COUNT || ffbProfileResetPending)
+		return;
+	const FFBStageStats& stats = ffbProfileStats[stage];
+	report->count = stats.count > 0xFFFF ? 0xFFFF : stats.count;
+	report->min = stats.min;
+	report->max = stats.max;
+	report->mean = stats.count ? stats.total / stats.count : 0;
+	memcpy(report->buckets, stats.buckets, sizeof(report->buckets));
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _FFBPROFILE_H
+#define _FFBPROFILE_H
+#include <Arduino.h>
+
+// Set to 1 to time the force feedback pipeline stages in microseconds.
+// When 0 the FFB_PROFILE_* macros compile to nothing.
+#ifndef FFB_PROFILE
+#define FFB_PROFILE 0
+#endif
+
+// Histogram buckets: <8us, <16us, <32us, ... doubling, the last one is open ended.
+#define FFB_PROFILE_BUCKETS 8
+
+// Stages, the force calculation of each effect type has its own stage.
+#define FFB_STAGE_USB_RECV		0	// reading one PID OUT packet
+#define FFB_STAGE_PARSE			1	// UppackUsbData
+#define FFB_STAGE_FORCE			2	// forceCalculator, all effects
+#define FFB_STAGE_INPUT_SEND	3	// building and sending the joystick input report
+#define FFB_STAGE_EFFECT		4	// + effectType - 1, one effect's force
+#define FFB_PROFILE_STAGE_COUNT	(FFB_STAGE_EFFECT + 12)
+#define FFB_STAGE_EFFECT_TYPE(type)	((type) >= 1 ? FFB_STAGE_EFFECT + (type) - 1 : FFB_PROFILE_STAGE_COUNT)
+
+// Vendor defined feature report in the PID report ID range. The host writes
+// a stage number (0xFF resets all stages), then reads that stage's stats.
+// The stats are global, every force feedback joystick reads and resets the
+// same ones.
+#define FFB_PROFILE_REPORT_ID	9
+
+typedef struct {
+	uint32_t count;
+	uint32_t total;	// us, for the mean
+	uint16_t min, max;	// us
+	uint16_t buckets[FFB_PROFILE_BUCKETS];	// saturating
+} FFBStageStats;
+
+typedef struct//Vendor: Profile Feature Report
+{
+	uint8_t reportId;	// =9
+	uint8_t stage;
+	uint16_t count;	// saturating
+	uint16_t min, max, mean;	// us
+	uint16_t buckets[FFB_PROFILE_BUCKETS];
+} FFBProfile_Feature_Data_t;
+
+#if FFB_PROFILE
+extern FFBStageStats ffbProfileStats[FFB_PROFILE_STAGE_COUNT];
+extern uint8_t ffbProfileSelectedStage;
+// Set from the USB interrupt, the next record or read in the main loop resets
+extern volatile uint8_t ffbProfileResetPending;
+
+// Main loop only, the feature report is served from the USB interrupt
+void ffbProfileRecord(uint8_t stage, unsigned long us);
+void ffbProfileReset();
+// Stats of stage, all zero for a stage that does not exist
+const FFBStageStats& ffbProfileStage(uint8_t stage);
+// From the USB interrupt
+void ffbProfileReport(FFBProfile_Feature_Data_t* report, uint8_t stage);
+
+#define FFB_PROFILE_BEGIN(start)		unsigned long start = micros()
+#define FFB_PROFILE_END(stage, start)	ffbProfileRecord((stage), micros() - (start))
+#else
+#define FFB_PROFILE_BEGIN(start)
+#define FFB_PROFILE_END(stage, start)
+#endif
+
+#endif
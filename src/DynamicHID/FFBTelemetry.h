@@ -0,0 +1,39 @@
+#ifndef _FFBTELEMETRY_H
+#define _FFBTELEMETRY_H
+#include <Arduino.h>
+#include "PIDReportType.h"
+
+// Set to 1 to stream force feedback telemetry frames to the host for tuning.
+// When 0 no telemetry report is described and nothing is sent.
+#ifndef FFB_TELEMETRY
+#define FFB_TELEMETRY 0
+#endif
+
+// Vendor defined input report in the PID report ID range. It shares the ID
+// with the profiling feature report, input and feature reports do not clash.
+#define FFB_TELEMETRY_REPORT_ID	9
+
+// One frame per telemetry period, built by getForce(). Each frame carries the
+// contribution of one playing effect and the metrics of one axis, taking
+// turns, so the frame stays within a 64 byte packet for every axis count.
+typedef struct//Vendor: Telemetry Input Report
+{
+	uint8_t reportId;	// =9
+	uint8_t sequence;	// +1 per frame built, a gap means frames were dropped
+	uint8_t effectId;	// effect of effectForce, 0 if none is playing
+	uint8_t metricsAxis;	// force feedback axis of the metrics
+	uint16_t time;	// ms, effect clock
+	uint16_t loopTime;	// us since the previous getForce() started calculating
+	int32_t springPosition;	// EffectParams of metricsAxis
+	int32_t damperVelocity;
+	int32_t inertiaAcceleration;
+	int32_t frictionPositionChange;
+	uint16_t calcTime;	// us spent calculating the forces
+	int16_t force[MAX_FFB_AXIS_COUNT];	// summed, as returned by getForce()
+	int16_t effectForce[MAX_FFB_AXIS_COUNT];	// contribution of effectId, before scaling
+} FFBTelemetry_Input_Data_t;
+
+// Wire size including the report ID, without any trailing struct padding
+#define FFB_TELEMETRY_REPORT_SIZE	(26 + 4 * MAX_FFB_AXIS_COUNT)
+
+#endif
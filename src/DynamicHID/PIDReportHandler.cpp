@@ -1,5 +1,9 @@
 #include "PIDReportHandler.h"
-#if 1
+// Set to 1 to trace the PID reports over Serial. This pulls in Serial and its buffers.
+#ifndef PID_DEBUG
+#define PID_DEBUG 0
+#endif
+#if PID_DEBUG
 #define DEBUG_PRINT(x)	Serial.print(x)
 #define DEBUG_PRINTLN(x)	Serial.println(x)
 #else
@@ -9,8 +13,12 @@
 
 PIDReportHandler::PIDReportHandler() 
 {
-	nextEID = 1;
+	poolGeneration = 1;
+	nextUnusedEID = 1;
+	freeListHead = 0;
 	devicePaused = 0;
+	deviceGain.gain = 255;
+	clock = millis;
 	memset(&g_EffectStates, 0, sizeof(g_EffectStates));
 }
 
@@ -22,8 +30,14 @@ PIDReportHandler::~PIDReportHandler()
 void PIDReportHandler::EnableDefaultEffect(const TEffectState &effect)
 {
 	memcpy(&g_EffectStates[0], &effect, sizeof(TEffectState));
+	g_EffectStates[0].state = MEFFECTSTATE_ALLOCATED;
+	UpdatePhase(&g_EffectStates[0]);
 	const uint8_t id = GetNextFreeEffect();
+	if (id == 0)
+		return;
 	memcpy(&g_EffectStates[id], &g_EffectStates[0], sizeof(TEffectState));
+	g_EffectStates[id].generation = poolGeneration;
+	effectGainsDirty |= 1u << id;
 	if (id != 1)
 	{
 		DEBUG_PRINT("nextEID != 1: ");
@@ -55,10 +69,13 @@ void PIDReportHandler::PrintEffect(uint8_t id)
 	DEBUG_PRINTLN(g_EffectStates[id].magnitude);
 	DEBUG_PRINT("  enableAxis ");
 	DEBUG_PRINTLN(g_EffectStates[id].enableAxis);
-	DEBUG_PRINT("   directionX ");
-	DEBUG_PRINTLN(g_EffectStates[id].directionX);
-	DEBUG_PRINT("  directionY ");
-	DEBUG_PRINTLN(g_EffectStates[id].directionY);
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		DEBUG_PRINT("  direction ");
+		DEBUG_PRINT(axis);
+		DEBUG_PRINT(" ");
+		DEBUG_PRINTLN(g_EffectStates[id].direction[axis]);
+	}
 	DEBUG_PRINT("  phase ");
 	DEBUG_PRINTLN(g_EffectStates[id].phase);
 	DEBUG_PRINT("  startMagnitude ");
@@ -93,69 +110,85 @@ void PIDReportHandler::PrintEffect(uint8_t id)
 
 uint8_t PIDReportHandler::GetNextFreeEffect(void)
 {
-	if (nextEID == MAX_EFFECTS)
-		return 0;
-
-	uint8_t id = nextEID++;
+	uint8_t id = freeListHead;
 
-	while (g_EffectStates[nextEID].state != 0)
-	{
-		if (nextEID >= MAX_EFFECTS)
-			break;  // the last spot was taken
-		nextEID++;
-	}
+	if (id != 0)
+		freeListHead = freeList[id];
+	else if (nextUnusedEID <= MAX_EFFECTS)
+		id = nextUnusedEID++;
+	else
+		return 0;
 
 	g_EffectStates[id].state = MEFFECTSTATE_ALLOCATED;
+	g_EffectStates[id].generation = poolGeneration;
 
 	return id;
 }
 
 void PIDReportHandler::StopAllEffects(void)
 {
-	for (uint8_t id = 0; id <= MAX_EFFECTS; id++)
+	for (uint8_t id = 1; id <= MAX_EFFECTS; id++)
 		StopEffect(id);
 }
 
 void PIDReportHandler::StartEffect(uint8_t id)
 {
-	if (id > MAX_EFFECTS)
+	if (!IsEffectAllocated(id))
 		return;
+	if (g_EffectStates[id].state != MEFFECTSTATE_PLAYING)
+		pidStatePendingEffects |= (1u << id);
 	g_EffectStates[id].state = MEFFECTSTATE_PLAYING;
+	playingEffects |= (1u << id);
 	g_EffectStates[id].elapsedTime = 0;
-	// TODO: Casting 32 to 64 bit is probably not right?
-	g_EffectStates[id].startTime = (uint64_t)millis();
+	effectForcesValid &= ~(1u << id);
+	g_EffectStates[id].startTime = clock();
 }
 
 void PIDReportHandler::StopEffect(uint8_t id)
 {
-	if (id > MAX_EFFECTS)
+	if (!IsEffectAllocated(id))
 		return;
+	if (g_EffectStates[id].state == MEFFECTSTATE_PLAYING)
+		pidStatePendingEffects |= (1u << id);
 	g_EffectStates[id].state = MEFFECTSTATE_ALLOCATED;
+	playingEffects &= ~(1u << id);
 }
 
 void PIDReportHandler::FreeEffect(uint8_t id)
 {
-	if (id > MAX_EFFECTS)
+	if (!IsEffectAllocated(id))
 		return;
-	g_EffectStates[id].state = 0;
-	if (id < nextEID)
-		nextEID = id;
+	g_EffectStates[id].state = MEFFECTSTATE_FREE;
+	playingEffects &= ~(1u << id);
+	pidStatePendingEffects &= ~(1u << id);
+	freeList[id] = freeListHead;
+	freeListHead = id;
 	pidBlockLoad.ramPoolAvailable += SIZE_EFFECT;
 }
 
 void PIDReportHandler::FreeAllEffects(void)
 {
-	nextEID = 1;
-	for (uint8_t i = 1; i < MAX_EFFECTS + 1; ++i)
+	nextUnusedEID = 1;
+	freeListHead = 0;
+	pidStatePendingEffects = 0;
+	playingEffects = 0;
+	pidStatusChanged = 1;
+	effectGainsDirty = 0xFFFF;
+	effectForcesValid = 0;
+	if (++poolGeneration == 0)
 	{
-		memset(&g_EffectStates[i], 0, sizeof(TEffectState));
+		// The generation wrapped, so stale slots could match it again.
+		for (uint8_t i = 1; i < MAX_EFFECTS + 1; ++i)
+			g_EffectStates[i].generation = 0;
+		poolGeneration = 1;
 	}
 	if (g_EffectStates[0].state != MEFFECTSTATE_FREE)
 	{
 		// Default effect is enabled.
-		memcpy(&g_EffectStates[1], &g_EffectStates[0], sizeof(TEffectState));
-		nextEID += 1;
-		StartEffect(1);
+		const uint8_t id = GetNextFreeEffect();
+		memcpy(&g_EffectStates[id], &g_EffectStates[0], sizeof(TEffectState));
+		g_EffectStates[id].generation = poolGeneration;
+		StartEffect(id);
 	}
 	pidBlockLoad.ramPoolAvailable = MEMORY_SIZE;
 	DEBUG_PRINTLN("Freed All Effects");
@@ -208,10 +241,12 @@ void PIDReportHandler::DeviceControl(USB_FFBReport_DeviceControl_Output_Data_t*
 	if (control == 0x01)
 	{ // 1=Enable Actuators
 		pidState.status |= 2;
+		pidStatusChanged = 1;
 	}
 	else if (control == 0x02)
 	{ // 2=Disable Actuators
 		pidState.status &= ~(0x02);
+		pidStatusChanged = 1;
 	}
 	else if (control == 0x03)
 	{ // 3=Stop All Effects
@@ -224,10 +259,14 @@ void PIDReportHandler::DeviceControl(USB_FFBReport_DeviceControl_Output_Data_t*
 	else if (control == 0x05)
 	{ // 5=Pause
 		devicePaused = 1;
+		pidState.status |= 1;
+		pidStatusChanged = 1;
 	}
 	else if (control == 0x06)
 	{ // 6=Continue
 		devicePaused = 0;
+		pidState.status &= ~(0x01);
+		pidStatusChanged = 1;
 	}
 	else if (control & (0xFF - 0x3F))
 	{
@@ -237,6 +276,7 @@ void PIDReportHandler::DeviceControl(USB_FFBReport_DeviceControl_Output_Data_t*
 void PIDReportHandler::DeviceGain(USB_FFBReport_DeviceGain_Output_Data_t* data)
 {
 	deviceGain.gain = data->gain;
+	effectGainsDirty = 0xFFFF;
 }
 
 void PIDReportHandler::SetCustomForce(USB_FFBReport_SetCustomForce_Output_Data_t* data)
@@ -256,15 +296,14 @@ void PIDReportHandler::SetEffect(USB_FFBReport_SetEffect_Output_Data_t* data)
 	volatile TEffectState* effect = &g_EffectStates[data->effectBlockIndex];
 
 	effect->duration = data->duration;
-	effect->directionX = data->directionX;
-	effect->directionY = data->directionY;
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+		effect->direction[axis] = data->direction[axis];
 	effect->effectType = data->effectType;
 	effect->gain = data->gain;
 	effect->enableAxis = data->enableAxis;
-	DEBUG_PRINT("dX: ");
-	DEBUG_PRINT(effect->directionX);
-	DEBUG_PRINT(" dX: ");
-	DEBUG_PRINT(effect->directionY);
+	effectGainsDirty |= 1u << data->effectBlockIndex;
+	DEBUG_PRINT("d0: ");
+	DEBUG_PRINT(effect->direction[0]);
 	DEBUG_PRINT(" eT: ");
 	DEBUG_PRINT(effect->effectType);
 	DEBUG_PRINT(" eA: ");
@@ -281,7 +320,9 @@ void PIDReportHandler::SetEnvelope(USB_FFBReport_SetEnvelope_Output_Data_t* data
 
 void PIDReportHandler::SetCondition(USB_FFBReport_SetCondition_Output_Data_t* data, volatile TEffectState* effect)
 {
-	uint8_t axis = data->parameterBlockOffset; 
+	uint8_t axis = data->parameterBlockOffset & 0x0F;
+	if (axis >= MAX_FFB_AXIS_COUNT)
+		return;
     effect->conditions[axis].cpOffset = data->cpOffset;
     effect->conditions[axis].positiveCoefficient = data->positiveCoefficient;
     effect->conditions[axis].negativeCoefficient = data->negativeCoefficient;
@@ -289,6 +330,9 @@ void PIDReportHandler::SetCondition(USB_FFBReport_SetCondition_Output_Data_t* da
     effect->conditions[axis].negativeSaturation = data->negativeSaturation;
     effect->conditions[axis].deadBand = data->deadBand;
 	effect->conditionBlocksCount++;
+	// The block count picks the condition force routine's axis mode
+	if (effect->conditionBlocksCount <= 2)
+		effectGainsDirty |= 1u << (effect - g_EffectStates);
 }
 
 void PIDReportHandler::SetPeriodic(USB_FFBReport_SetPeriodic_Output_Data_t* data, volatile TEffectState* effect)
@@ -297,6 +341,7 @@ void PIDReportHandler::SetPeriodic(USB_FFBReport_SetPeriodic_Output_Data_t* data
 	effect->offset = data->offset;
 	effect->phase = data->phase;
 	effect->period = data->period;
+	UpdatePhase(effect);
 
 	DEBUG_PRINT(" m: ");
 	DEBUG_PRINTLN(effect->magnitude);
@@ -308,6 +353,17 @@ void PIDReportHandler::SetPeriodic(USB_FFBReport_SetPeriodic_Output_Data_t* data
 	DEBUG_PRINTLN(effect->period);
 }
 
+// The periodic effects find their position in the cycle with a multiply, so
+// the divisions by period happen here, once per Set Periodic report.
+void PIDReportHandler::UpdatePhase(volatile TEffectState* effect)
+{
+	// 2^32 / period rounded up, so a whole period wraps the position to 0 exactly.
+	// Period 0 and 1 give 0: the position stays at phaseStart.
+	effect->phaseStep = effect->period ? 0xFFFFFFFFUL / effect->period + 1 : 0;
+	// phase is in 0.01 degrees, 36000 is one cycle. Larger values wrap.
+	effect->phaseStart = (uint16_t)((uint32_t)effect->phase * 65536 / 36000);
+}
+
 void PIDReportHandler::SetConstantForce(USB_FFBReport_SetConstantForce_Output_Data_t* data, volatile TEffectState* effect)
 {
 	//  ReportPrint(*effect);
@@ -337,80 +393,121 @@ void PIDReportHandler::CreateNewEffect(USB_FFBReport_CreateNewEffect_Feature_Dat
 
 		memset((void*)effect, 0, sizeof(TEffectState));
 		effect->state = MEFFECTSTATE_ALLOCATED;
+		effect->generation = poolGeneration;
+		effectForcesValid &= ~(1u << pidBlockLoad.effectBlockIndex);
 		pidBlockLoad.ramPoolAvailable -= SIZE_EFFECT;
 	}
 }
 
-void PIDReportHandler::UppackUsbData(uint8_t* data, uint16_t len)
+static void OnSetEffect(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetEffect((USB_FFBReport_SetEffect_Output_Data_t*)data);
+}
+
+static void OnSetEnvelope(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetEnvelope((USB_FFBReport_SetEnvelope_Output_Data_t*)data, &pid->g_EffectStates[data[1]]);
+}
+
+static void OnSetCondition(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetCondition((USB_FFBReport_SetCondition_Output_Data_t*)data, &pid->g_EffectStates[data[1]]);
+}
+
+static void OnSetPeriodic(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetPeriodic((USB_FFBReport_SetPeriodic_Output_Data_t*)data, &pid->g_EffectStates[data[1]]);
+}
+
+static void OnSetConstantForce(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetConstantForce((USB_FFBReport_SetConstantForce_Output_Data_t*)data, &pid->g_EffectStates[data[1]]);
+}
+
+static void OnSetRampForce(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetRampForce((USB_FFBReport_SetRampForce_Output_Data_t*)data, &pid->g_EffectStates[data[1]]);
+}
+
+static void OnSetCustomForceData(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetCustomForceData((USB_FFBReport_SetCustomForceData_Output_Data_t*)data);
+}
+
+static void OnSetDownloadForceSample(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetDownloadForceSample((USB_FFBReport_SetDownloadForceSample_Output_Data_t*)data);
+}
+
+static void OnEffectOperation(PIDReportHandler* pid, uint8_t* data)
 {
-	DEBUG_PRINT("len:");
-	DEBUG_PRINTLN(len);
+	pid->EffectOperation((USB_FFBReport_EffectOperation_Output_Data_t*)data);
+}
+
+static void OnBlockFree(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->BlockFree((USB_FFBReport_BlockFree_Output_Data_t*)data);
+}
 
-	uint8_t effectId = data[1]; // effectBlockIndex is always the second byte.
+static void OnDeviceControl(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->DeviceControl((USB_FFBReport_DeviceControl_Output_Data_t*)data);
+}
 
-	DEBUG_PRINT("id:");
-	DEBUG_PRINTLN(effectId);
+static void OnDeviceGain(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->DeviceGain((USB_FFBReport_DeviceGain_Output_Data_t*)data);
+}
 
-	switch (data[0])    // reportID
+static void OnSetCustomForce(PIDReportHandler* pid, uint8_t* data)
+{
+	pid->SetCustomForce((USB_FFBReport_SetCustomForce_Output_Data_t*)data);
+}
+
+typedef struct
+{
+	uint8_t minLength;	// shortest packet the handler may read, the report length
+	uint8_t needsEffect;	// data[1] must be an allocated effect index
+	void (*handler)(PIDReportHandler* pid, uint8_t* data);
+} PIDOutputReport;
+
+// Output reports indexed by report ID - 1.
+static_assert(sizeof(USB_FFBReport_SetEffect_Output_Data_t) == 14 + MAX_FFB_AXIS_COUNT, "Set Effect report is padded");
+static_assert(sizeof(USB_FFBReport_SetCondition_Output_Data_t) == 15, "Set Condition report is padded");
+static const PIDOutputReport outputReports[PID_REPORT_ID_COUNT] PROGMEM = {
+	{ sizeof(USB_FFBReport_SetEffect_Output_Data_t), 1, OnSetEffect },	// 1
+	{ sizeof(USB_FFBReport_SetEnvelope_Output_Data_t), 1, OnSetEnvelope },	// 2
+	{ sizeof(USB_FFBReport_SetCondition_Output_Data_t), 1, OnSetCondition },	// 3
+	{ sizeof(USB_FFBReport_SetPeriodic_Output_Data_t), 1, OnSetPeriodic },	// 4
+	{ sizeof(USB_FFBReport_SetConstantForce_Output_Data_t), 1, OnSetConstantForce },	// 5
+	{ sizeof(USB_FFBReport_SetRampForce_Output_Data_t), 1, OnSetRampForce },	// 6
+	{ sizeof(USB_FFBReport_SetCustomForceData_Output_Data_t), 1, OnSetCustomForceData },	// 7
+	{ sizeof(USB_FFBReport_SetDownloadForceSample_Output_Data_t), 0, OnSetDownloadForceSample },	// 8
+	{ 0, 0, NULL },	// 9
+	{ sizeof(USB_FFBReport_EffectOperation_Output_Data_t), 1, OnEffectOperation },	// 10
+	{ sizeof(USB_FFBReport_BlockFree_Output_Data_t), 0, OnBlockFree },	// 11, 0xFF frees all
+	{ sizeof(USB_FFBReport_DeviceControl_Output_Data_t), 0, OnDeviceControl },	// 12
+	{ sizeof(USB_FFBReport_DeviceGain_Output_Data_t), 0, OnDeviceGain },	// 13
+	{ sizeof(USB_FFBReport_SetCustomForce_Output_Data_t), 1, OnSetCustomForce },	// 14
+};
+
+void PIDReportHandler::UppackUsbData(uint8_t* data, uint16_t len)
+{
+	FFB_PROFILE_BEGIN(start);
+	uint8_t reportId = data[0];
+	if (len > 0 && reportId >= 1 && reportId <= PID_REPORT_ID_COUNT)
 	{
-	case 1:
-		DEBUG_PRINTLN("SetEffect");
-		SetEffect((USB_FFBReport_SetEffect_Output_Data_t*)data);
-		break;
-	case 2:
-		DEBUG_PRINTLN("SetEnvelop");
-		SetEnvelope((USB_FFBReport_SetEnvelope_Output_Data_t*)data, &g_EffectStates[effectId]);
-		break;
-	case 3:
-		DEBUG_PRINTLN("SetCondition");
-		SetCondition((USB_FFBReport_SetCondition_Output_Data_t*)data, &g_EffectStates[effectId]);
-		break;
-	case 4:
-		DEBUG_PRINTLN("SetPeriodic");
-		SetPeriodic((USB_FFBReport_SetPeriodic_Output_Data_t*)data, &g_EffectStates[effectId]);
-		break;
-	case 5:
-		DEBUG_PRINTLN("SetConstantForce");
-		SetConstantForce((USB_FFBReport_SetConstantForce_Output_Data_t*)data, &g_EffectStates[effectId]);
-		PrintEffect(effectId);
-		break;
-	case 6:
-		DEBUG_PRINTLN("SetRampForce");
-		SetRampForce((USB_FFBReport_SetRampForce_Output_Data_t*)data, &g_EffectStates[effectId]);
-		break;
-	case 7:
-		DEBUG_PRINTLN("SetCustomForceData");
-		SetCustomForceData((USB_FFBReport_SetCustomForceData_Output_Data_t*)data);
-		break;
-	case 8:
-		DEBUG_PRINTLN("SetDownloadForceSample");
-		SetDownloadForceSample((USB_FFBReport_SetDownloadForceSample_Output_Data_t*)data);
-		break;
-	case 9:
-		break;
-	case 10:
-		DEBUG_PRINTLN("EffectOperation");
-		EffectOperation((USB_FFBReport_EffectOperation_Output_Data_t*)data);
-		break;
-	case 11:
-		DEBUG_PRINTLN("BlockFree");
-		BlockFree((USB_FFBReport_BlockFree_Output_Data_t*)data);
-		break;
-	case 12:
-		DEBUG_PRINTLN("DeviceControl");
-		DeviceControl((USB_FFBReport_DeviceControl_Output_Data_t*)data);
-		break;
-	case 13:
-		DEBUG_PRINTLN("DeviceGain");
-		DeviceGain((USB_FFBReport_DeviceGain_Output_Data_t*)data);
-		break;
-	case 14:
-		DEBUG_PRINTLN("SetCustomForce");
-		SetCustomForce((USB_FFBReport_SetCustomForce_Output_Data_t*)data);
-		break;
-	default:
-		break;
+		PIDOutputReport report;
+		memcpy_P(&report, &outputReports[reportId - 1], sizeof(report));
+		if (report.handler != NULL && len >= report.minLength &&
+			(!report.needsEffect || IsEffectAllocated(data[1])))
+		{
+			report.handler(this, data);
+			if (report.needsEffect)
+				effectForcesValid &= ~(1u << data[1]);
+		}
 	}
+	FFB_PROFILE_END(FFB_STAGE_PARSE, start);
 }
 
 uint8_t* PIDReportHandler::getPIDPool()
@@ -432,4 +529,30 @@ uint8_t* PIDReportHandler::getPIDBlockLoad()
 uint8_t* PIDReportHandler::getPIDStatus()
 {
 	return (uint8_t*)& pidState;
+}
+
+bool PIDReportHandler::PIDStateReportDue()
+{
+	if (!pidStatePendingEffects && !pidStatusChanged)
+		return false;
+	return (clock() - lastPIDStateTime) >= PID_STATE_REPORT_INTERVAL;
+}
+
+uint8_t* PIDReportHandler::PopPIDState()
+{
+	// Several changes of one effect between two reports collapse into a single
+	// report of its current state; a status-only change reports no effect.
+	uint8_t id = 0;
+	if (pidStatePendingEffects) {
+		id = 1;
+		while (!(pidStatePendingEffects & (1u << id)))
+			id++;
+		pidStatePendingEffects &= ~(1u << id);
+		pidState.effectBlockIndex = (id << 1) | (g_EffectStates[id].state == MEFFECTSTATE_PLAYING ? 1 : 0);
+	} else {
+		pidState.effectBlockIndex = 0;
+	}
+	pidStatusChanged = 0;
+	lastPIDStateTime = clock();
+	return (uint8_t*)& pidState;
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
 #define _PIDREPORTHANDLER_H
 #include <Arduino.h>
 #include "PIDReportType.h"
+#include "FFBProfile.h"
+#include "FFBTelemetry.h"
+
+// Minimum time between two PID State input reports, in ms.
+#define PID_STATE_REPORT_INTERVAL 2
 
 class PIDReportHandler {
 public:
@@ -11,7 +16,13 @@ public:
 	// FFP effect indexes start from 1.
 	// The 0th effect is used to remember default effect parameters, and is copied
 	// to index 1 after freeing all effects.
-	volatile uint8_t nextEID;
+	// Slots are handed out from a free list, falling back to the never-used slots
+	// above nextUnusedEID. Freeing all effects only bumps poolGeneration, so slots
+	// allocated in an older generation are treated as free without clearing them.
+	volatile uint8_t poolGeneration;
+	volatile uint8_t nextUnusedEID;
+	volatile uint8_t freeListHead;
+	volatile uint8_t freeList[MAX_EFFECTS + 1];
 	volatile TEffectState  g_EffectStates[MAX_EFFECTS + 1];
 	volatile uint8_t devicePaused;
 	//variables for storing previous values
@@ -19,9 +30,25 @@ public:
 	volatile int16_t oldSpeed = 0;
 	volatile int16_t oldAxisPosition = 0;
 	volatile USB_FFBReport_PIDStatus_Input_Data_t pidState = { 2, 30, 0 };
+	// Effects whose playing state changed (bit per effect id) and device status
+	// changes that have not been reported to the host yet.
+	volatile uint16_t pidStatePendingEffects = 0;
+	volatile uint8_t pidStatusChanged = 0;
+	unsigned long lastPIDStateTime = 0;
+	// Effects in the current pool that are playing (bit per effect id). The
+	// force loop and telemetry take the playing effects from here, not from
+	// the state of each slot.
+	volatile uint16_t playingEffects = 0;
+	// Effects whose axisGain must be recomputed (bit per effect id).
+	volatile uint16_t effectGainsDirty = 0;
+	// Effects whose forceCache is still valid (bit per effect id), cleared by
+	// every report that changes the effect.
+	volatile uint16_t effectForcesValid = 0;
 	volatile USB_FFBReport_PIDBlockLoad_Feature_Data_t pidBlockLoad;
 	volatile USB_FFBReport_PIDPool_Feature_Data_t pidPoolReport;
 	volatile USB_FFBReport_DeviceGain_Output_Data_t deviceGain;
+	// Time source for effect playback in ms, millis() unless replaced.
+	unsigned long (*clock)(void);
 
 	// Enables a default effect with the given effect parameters.
 	// This function must be called during initialization.
@@ -31,6 +58,12 @@ public:
 	void PrintEffect(uint8_t id);
 
 	//ffb state structures
+	bool IsEffectAllocated(uint8_t id)
+	{
+		return id >= 1 && id <= MAX_EFFECTS &&
+			g_EffectStates[id].state != MEFFECTSTATE_FREE &&
+			g_EffectStates[id].generation == poolGeneration;
+	}
 	uint8_t GetNextFreeEffect(void);
 	void StartEffect(uint8_t id);
 	void StopEffect(uint8_t id);
@@ -50,6 +83,8 @@ public:
 	void SetEnvelope(USB_FFBReport_SetEnvelope_Output_Data_t* data, volatile TEffectState* effect);
 	void SetCondition(USB_FFBReport_SetCondition_Output_Data_t* data, volatile TEffectState* effect);
 	void SetPeriodic(USB_FFBReport_SetPeriodic_Output_Data_t* data, volatile TEffectState* effect);
+	// Sets phaseStep and phaseStart from period and phase
+	void UpdatePhase(volatile TEffectState* effect);
 	void SetConstantForce(USB_FFBReport_SetConstantForce_Output_Data_t* data, volatile TEffectState* effect);
 	void SetRampForce(USB_FFBReport_SetRampForce_Output_Data_t* data, volatile TEffectState* effect);
 
@@ -59,5 +94,9 @@ public:
 	uint8_t* getPIDPool();
 	uint8_t* getPIDBlockLoad();
 	uint8_t* getPIDStatus();
+	// True when a state change is waiting and the report interval has passed.
+	bool PIDStateReportDue();
+	// Fills pidState with the next pending change and returns it.
+	uint8_t* PopPIDState();
 };
 #endif
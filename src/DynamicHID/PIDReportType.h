@@ -27,14 +27,32 @@
 #ifndef _PIDREPORTTYPE_H
 #define _PIDREPORTTYPE_H
 
+// Effects the host can load at once, each takes sizeof(TEffectState) bytes of RAM.
+// At most 15, effects are tracked in 16 bit masks with a bit per effect id.
+#ifndef MAX_EFFECTS
 #define MAX_EFFECTS 14
+#endif
+#if MAX_EFFECTS < 1 || MAX_EFFECTS > 15
+#error MAX_EFFECTS must be between 1 and 15
+#endif
+// PID reports use report IDs 1..PID_REPORT_ID_COUNT, offset per device.
+#define PID_REPORT_ID_COUNT 14
+// Number of force feedback axes (X, Y, Z, Rx, Ry, Rz), 1..6.
+#ifndef MAX_FFB_AXIS_COUNT
 #define MAX_FFB_AXIS_COUNT 0x02
+#endif
+#if MAX_FFB_AXIS_COUNT < 1 || MAX_FFB_AXIS_COUNT > 6
+#error MAX_FFB_AXIS_COUNT must be between 1 and 6
+#endif
 #define SIZE_EFFECT sizeof(TEffectState)
 #define MEMORY_SIZE (uint16_t)(MAX_EFFECTS*SIZE_EFFECT)
 #define TO_LT_END_16(x) ((x<<8)&0xFF00)|((x>>8)&0x00FF)
 
 
 ////refer to FFBDescriptor.h
+// The report structs below are the reports as they go over the wire, without
+// padding on any target, so sizeof() is the report length.
+#pragma pack(push, 1)
 
 ///Device-->Host
 
@@ -42,7 +60,7 @@ typedef struct//PID state
 {
 	uint8_t reportId;//2
 	uint8_t	status;// Bits: 0=Device Paused,1=Actuators Enabled,2=Safety Switch,3=Actuator Override Switch,4=Actuator Power
-	uint8_t	effectBlockIndex;// Bit7=Effect Playing, Bit0..7=EffectId (1..40)
+	uint8_t	effectBlockIndex;// Bit0=Effect Playing, Bit1..7=EffectId (1..40)
 }USB_FFBReport_PIDStatus_Input_Data_t;
 
 ///Host-->Device
@@ -57,9 +75,8 @@ typedef struct //FFB: Set Effect Output Report
 	uint16_t samplePeriod;	// 0..32767 ms
 	uint8_t	gain;	// 0..255	 (physical 0..10000)
 	uint8_t	triggerButton;	// button ID (0..8)
-	uint8_t	enableAxis; // bits: 0=X, 1=Y, 2=DirectionEnable
-	uint8_t	directionX;	// angle (0=0 .. 255=360deg)
-	uint8_t	directionY;	// angle (0=0 .. 255=360deg)
+	uint8_t	enableAxis; // bits: 0..MAX_FFB_AXIS_COUNT-1=axes, MAX_FFB_AXIS_COUNT=DirectionEnable
+	uint8_t	direction[MAX_FFB_AXIS_COUNT];	// angle (0=0 .. 255=360deg)
 	uint16_t	startDelay;	// 0..32767 ms
 } USB_FFBReport_SetEffect_Output_Data_t;
 
@@ -92,7 +109,7 @@ typedef struct//FFB: Set Periodic Output Report
 	uint8_t	effectBlockIndex;	// 1..40
 	uint16_t magnitude;
 	int16_t	offset;
-	uint16_t	phase;	// 0..255 (=0..359, exp-2)
+	uint16_t	phase;	// 0..35999 (=0..359.99 deg, exp-2)
 	uint32_t	period;	// 0..32767 ms
 } USB_FFBReport_SetPeriodic_Output_Data_t;
 
@@ -143,7 +160,7 @@ typedef struct//FFB: Block Free Output Report
 typedef struct//FFB: Device Control Output Report
 {
 	uint8_t	reportId;	// =12
-	uint8_t control;	// 1=Enable Actuators, 2=Disable Actuators, 4=Stop All Effects, 8=Reset, 16=Pause, 32=Continue
+	uint8_t control;	// 1=Enable Actuators, 2=Disable Actuators, 3=Stop All Effects, 4=Reset, 5=Pause, 6=Continue
 } USB_FFBReport_DeviceControl_Output_Data_t;
 
 typedef struct//FFB: DeviceGain Output Report
@@ -183,6 +200,7 @@ typedef struct// FFB: PID Pool Feature Report
 	uint8_t		maxSimultaneousEffects;	// ?? 40?
 	uint8_t		memoryManagement;	// Bits: 0=DeviceManagedPool, 1=SharedParameterBlocks
 } USB_FFBReport_PIDPool_Feature_Data_t;
+#pragma pack(pop)
 
 typedef struct {
 	int16_t cpOffset; // -128..127
@@ -216,15 +234,20 @@ typedef struct {
 
 #define X_AXIS_ENABLE				0x01
 #define Y_AXIS_ENABLE				0x02
-#define DIRECTION_ENABLE			0x04
+#define DIRECTION_ENABLE			(1 << MAX_FFB_AXIS_COUNT)
 //these were needed for testing
 #define INERTIA_FORCE 				0xFF
 #define FRICTION_FORCE				0xFF
 #define INERTIA_DEADBAND			0x30
 #define FRICTION_DEADBAND			0x30
 
+// TEffectState.conditionAxes: one parameter block serves all axes, force goes along the direction
+#define CONDITION_SHARED_BLOCK		0x40
+#define CONDITION_PROJECTED			0x80
+
 typedef struct {
 	volatile uint8_t state;  // see constants <MEffectState_*>
+	uint8_t generation; // pool generation the effect was allocated in
 	uint8_t effectType; //
 	int16_t offset;
 	uint8_t gain;
@@ -234,18 +257,25 @@ typedef struct {
 
 	int16_t magnitude;
 	//direction
-	uint8_t enableAxis; // bits: 0=X, 1=Y, 2=DirectionEnable
-	uint8_t directionX; // angle (0=0 .. 255=360deg)
-	uint8_t directionY; // angle (0=0 .. 255=360deg)
+	uint8_t enableAxis; // bits: 0..MAX_FFB_AXIS_COUNT-1=axes, MAX_FFB_AXIS_COUNT=DirectionEnable
+	uint8_t direction[MAX_FFB_AXIS_COUNT]; // angle (0=0 .. 255=360deg)
+	uint16_t axisGain[MAX_FFB_AXIS_COUNT]; // effect, type, total and device gain combined, 0x8000=1.0
+	int16_t axisProjection[MAX_FFB_AXIS_COUNT]; // direction projected onto each axis, 0x7FFF=1.0
 	uint8_t conditionBlocksCount;
+	uint8_t forceRoutine; // effectType, 0 if it has no force routine; bound with axisGain
+	uint8_t conditionAxes; // bits: 0..MAX_FFB_AXIS_COUNT-1=axes, see CONDITION_* for the rest
     //condition
 	TEffectCondition conditions[MAX_FFB_AXIS_COUNT];
     //periodic
-	uint16_t phase;  // 0..255 (=0..359, exp-2)
+	uint16_t phase;  // 0..35999 (=0..359.99 deg, exp-2)
 	int16_t startMagnitude;
 	int16_t  endMagnitude;
 	uint16_t  period; // 0..32767 ms
-	uint16_t duration, elapsedTime;
-	uint64_t startTime;
+	uint32_t phaseStep; // cycle advance per ms, 2^32=one period, see PIDReportHandler::UpdatePhase()
+	uint16_t phaseStart; // position in the cycle at elapsedTime 0, 0x10000=one period
+	uint16_t duration;
+	unsigned long elapsedTime; // ms since startTime, full width so cycles and stops stay right past 65 s
+	unsigned long startTime; // clock() when started, elapsed time is taken modulo its wrap
+	int32_t forceCache[MAX_FFB_AXIS_COUNT]; // last contribution, valid while the effect is time invariant
 } TEffectState;
 #endif
@@ -113,11 +113,25 @@ static const uint8_t pidReportDescriptor[] PROGMEM= {
 	0xA1, 0x02,           //      Collection Datalink (Logical)
 	  0x05, 0x01,           //        Usage Page (Generic Desktop)
 	  0x09, 0x30,           //        Usage (X)//
+#if MAX_FFB_AXIS_COUNT > 1
 	  0x09, 0x31,           //        Usage (Y)//
+#endif
+#if MAX_FFB_AXIS_COUNT > 2
+	  0x09, 0x32,           //        Usage (Z)//
+#endif
+#if MAX_FFB_AXIS_COUNT > 3
+	  0x09, 0x33,           //        Usage (Rx)//
+#endif
+#if MAX_FFB_AXIS_COUNT > 4
+	  0x09, 0x34,           //        Usage (Ry)//
+#endif
+#if MAX_FFB_AXIS_COUNT > 5
+	  0x09, 0x35,           //        Usage (Rz)//
+#endif
 	  0x15, 0x00,           //        Logical Minimum (0)
 	  0x25, 0x01,           //        Logical Maximum (1)
 	  0x75, 0x01,           //        Report Size (1)
-	  0x95, 0x02,           //        Report Count (2)
+	  0x95, MAX_FFB_AXIS_COUNT, //     Report Count (MAX_FFB_AXIS_COUNT)
 	  0x91, 0x02,           //        Output (Data,Var,Abs)
 	0xC0,                 //      End Collection Datalink (Logical)
 
@@ -125,12 +139,28 @@ static const uint8_t pidReportDescriptor[] PROGMEM= {
 	0x09, 0x56,           //      Usage (Direction Enable)
 	0x95, 0x01,           //        Report Count (1)
 	0x91, 0x02,           //        Output (Data,Var,Abs)
-	0x95, 0x05,           //        Report Count (5)
+#if MAX_FFB_AXIS_COUNT < 7
+	0x95, 7 - MAX_FFB_AXIS_COUNT, //  Report Count (padding to a full byte)
 	0x91, 0x03,           //        Output (Constant, Variable)
+#endif
 	0x09, 0x57,           //      Usage (Direction)
 	0xA1, 0x02,           //        Collection Datalink (Logical)
 	  0x0B, 0x01, 0, 0x0A, 0,  //          Usage (Ordinals: Instance 1)
+#if MAX_FFB_AXIS_COUNT > 1
 	  0x0B, 0x02, 0, 0x0A, 0,  //          Usage (Ordinals: Instance 2)
+#endif
+#if MAX_FFB_AXIS_COUNT > 2
+	  0x0B, 0x03, 0, 0x0A, 0,  //          Usage (Ordinals: Instance 3)
+#endif
+#if MAX_FFB_AXIS_COUNT > 3
+	  0x0B, 0x04, 0, 0x0A, 0,  //          Usage (Ordinals: Instance 4)
+#endif
+#if MAX_FFB_AXIS_COUNT > 4
+	  0x0B, 0x05, 0, 0x0A, 0,  //          Usage (Ordinals: Instance 5)
+#endif
+#if MAX_FFB_AXIS_COUNT > 5
+	  0x0B, 0x06, 0, 0x0A, 0,  //          Usage (Ordinals: Instance 6)
+#endif
 	  0x66, 0x14, 0x00,     //          Unit (20)
 	  0x55, 0xFE,           //          Unit Exponent (254)
 	  0x15, 0x00,           //          Logical Minimum (0)
@@ -139,7 +169,7 @@ static const uint8_t pidReportDescriptor[] PROGMEM= {
 	  0x47, 0xA0, 0x8C, 0, 0, //          Physical Maximum (36000)
 	  0x66, 0x00, 0x00,     //          Unit (0)
 	  0x75, 0x08,           //          Report Size (8)
-	  0x95, 0x02,           //          Report Count (2)
+	  0x95, MAX_FFB_AXIS_COUNT, //       Report Count (MAX_FFB_AXIS_COUNT)
 	  0x91, 0x02,           //          Output (Data,Var,Abs)
 	  0x55, 0x00,           //          Unit Exponent (0)
 	  0x66, 0x00, 0x00,     //          Unit (0)
@@ -223,9 +253,9 @@ static const uint8_t pidReportDescriptor[] PROGMEM= {
 	0x91, 0x02,           //   Output (Data,Var,Abs)
 	0x09, 0x23,           //  Usage (Parameter Block Offset)
 	0x15, 0x00,           //   Logical Minimum (0)
-	0x25, 0x03,           //   Logical Maximum (3)
+	0x25, MAX_FFB_AXIS_COUNT - 1, // Logical Maximum (MAX_FFB_AXIS_COUNT - 1)
 	0x35, 0x00,           //   Physical Minimum (0)
-	0x45, 0x03,           //   Physical Maximum (3)
+	0x45, MAX_FFB_AXIS_COUNT - 1, // Physical Maximum (MAX_FFB_AXIS_COUNT - 1)
 	0x75, 0x04,           //   Report Size (4)
 	0x95, 0x01,           //   Report Count (1)
 	0x91, 0x02,           //   Output (Data,Var,Abs)
@@ -627,6 +657,62 @@ static const uint8_t pidReportDescriptor[] PROGMEM= {
 	0x95, 0x01, // REPORT_COUNT (01)
 	0xB1, 0x03, // FEATURE ( Cnst,Var,Abs)
   0xC0, // END COLLECTION ()
+
+#if FFB_PROFILE
+  // Pipeline profiling, see FFBProfile.h
+  0x06, 0x00, 0xFF, // USAGE_PAGE (Vendor Defined 0xFF00)
+  0x09, 0x01, // USAGE (Vendor Usage 1)
+  0xA1, 0x02, // COLLECTION (Logical)
+	0x85, FFB_PROFILE_REPORT_ID, // REPORT_ID (09)
+	0x09, 0x02, // USAGE (Vendor Usage 2, stage)
+	0x15, 0x00, // LOGICAL_MINIMUM (00)
+	0x26, 0xFF, 0x00, // LOGICAL_MAXIMUM (00 FF)
+	0x75, 0x08, // REPORT_SIZE (08)
+	0x95, 0x01, // REPORT_COUNT (01)
+	0xB1, 0x02, // FEATURE (Data,Var,Abs)
+	0x09, 0x03, // USAGE (Vendor Usage 3, count, min, max, mean, buckets)
+	0x27, 0xFF, 0xFF, 0x00, 0x00, // LOGICAL_MAXIMUM (00 00 FF FF)
+	0x75, 0x10, // REPORT_SIZE (10)
+	0x95, 4 + FFB_PROFILE_BUCKETS, // REPORT_COUNT
+	0xB1, 0x02, // FEATURE (Data,Var,Abs)
+  0xC0, // END COLLECTION ()
+#endif
+#if FFB_TELEMETRY
+  // Force loop telemetry, see FFBTelemetry.h
+  0x06, 0x00, 0xFF, // USAGE_PAGE (Vendor Defined 0xFF00)
+  0x09, 0x10, // USAGE (Vendor Usage 0x10)
+  0xA1, 0x02, // COLLECTION (Logical)
+	0x85, FFB_TELEMETRY_REPORT_ID, // REPORT_ID (09)
+	0x09, 0x11, // USAGE (Vendor Usage 0x11, sequence, effect ID, metrics axis)
+	0x15, 0x00, // LOGICAL_MINIMUM (00)
+	0x26, 0xFF, 0x00, // LOGICAL_MAXIMUM (00 FF)
+	0x75, 0x08, // REPORT_SIZE (08)
+	0x95, 0x03, // REPORT_COUNT (03)
+	0x81, 0x02, // INPUT (Data,Var,Abs)
+	0x09, 0x12, // USAGE (Vendor Usage 0x12, time, loop time)
+	0x27, 0xFF, 0xFF, 0x00, 0x00, // LOGICAL_MAXIMUM (00 00 FF FF)
+	0x75, 0x10, // REPORT_SIZE (10)
+	0x95, 0x02, // REPORT_COUNT (02)
+	0x81, 0x02, // INPUT (Data,Var,Abs)
+	0x09, 0x13, // USAGE (Vendor Usage 0x13, spring, damper, inertia and friction metrics)
+	0x17, 0x00, 0x00, 0x00, 0x80, // LOGICAL_MINIMUM (80 00 00 00)
+	0x27, 0xFF, 0xFF, 0xFF, 0x7F, // LOGICAL_MAXIMUM (7F FF FF FF)
+	0x75, 0x20, // REPORT_SIZE (20)
+	0x95, 0x04, // REPORT_COUNT (04)
+	0x81, 0x02, // INPUT (Data,Var,Abs)
+	0x09, 0x14, // USAGE (Vendor Usage 0x14, calculation time)
+	0x15, 0x00, // LOGICAL_MINIMUM (00)
+	0x27, 0xFF, 0xFF, 0x00, 0x00, // LOGICAL_MAXIMUM (00 00 FF FF)
+	0x75, 0x10, // REPORT_SIZE (10)
+	0x95, 0x01, // REPORT_COUNT (01)
+	0x81, 0x02, // INPUT (Data,Var,Abs)
+	0x09, 0x15, // USAGE (Vendor Usage 0x15, forces, effect forces)
+	0x16, 0x01, 0x80, // LOGICAL_MINIMUM (80 01)
+	0x26, 0xFF, 0x7F, // LOGICAL_MAXIMUM (7F FF)
+	0x95, 2 * MAX_FFB_AXIS_COUNT, // REPORT_COUNT
+	0x81, 0x02, // INPUT (Data,Var,Abs)
+  0xC0, // END COLLECTION ()
+#endif
 0xC0 // END COLLECTION ()
 };
 
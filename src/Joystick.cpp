@@ -22,11 +22,25 @@
 #include "FFBDescriptor.h"
 #if defined(_USING_DYNAMIC_HID)
 
+// Static RAM shared by all joysticks: the DynamicHID module, the descriptor
+// scratch of the constructor and the profiling stats
+#if FFB_PROFILE
+#define JOYSTICK_SHARED_RAM (sizeof(DynamicHID_) + JOYSTICK_DESCRIPTOR_BUFFER_SIZE + sizeof(FFBStageStats) * FFB_PROFILE_STAGE_COUNT)
+#else
+#define JOYSTICK_SHARED_RAM (sizeof(DynamicHID_) + JOYSTICK_DESCRIPTOR_BUFFER_SIZE)
+#endif
+
+#if JOYSTICK_RAM_BUDGET
+static_assert(sizeof(Joystick_) <= JOYSTICK_RAM_BUDGET, "Joystick_ is larger than JOYSTICK_RAM_BUDGET");
+#endif
+#if FFB_RAM_BUDGET
+static_assert(sizeof(PIDReportHandler) <= FFB_RAM_BUDGET, "PIDReportHandler is larger than FFB_RAM_BUDGET, lower MAX_EFFECTS or MAX_FFB_AXIS_COUNT");
+#endif
+#if JOYSTICK_SHARED_RAM_BUDGET
+static_assert(JOYSTICK_SHARED_RAM <= JOYSTICK_SHARED_RAM_BUDGET, "shared buffers are larger than JOYSTICK_SHARED_RAM_BUDGET");
+#endif
+
 #define JOYSTICK_REPORT_ID_INDEX 7
-#define JOYSTICK_AXIS_MINIMUM -32767
-#define JOYSTICK_AXIS_MAXIMUM 32767
-#define JOYSTICK_SIMULATOR_MINIMUM -32767
-#define JOYSTICK_SIMULATOR_MAXIMUM 32767
 
 #define JOYSTICK_INCLUDE_X_AXIS  B00000001
 #define JOYSTICK_INCLUDE_Y_AXIS  B00000010
@@ -41,6 +55,60 @@
 #define JOYSTICK_INCLUDE_BRAKE       B00001000
 #define JOYSTICK_INCLUDE_STEERING    B00010000
 
+// Report field size of a value, 8 to 16 bits, anything else is sent as 16 bits
+static uint8_t fieldBits(uint8_t bits)
+{
+	return (bits < 8 || bits > 16) ? 16 : bits;
+}
+
+// Appends the INPUT fields of count values, one main item per run of values
+// with the same bit depth, and adds their bits to valueBits. An n bit value
+// has the logical range -(2^(n-1) - 1) to 2^(n-1) - 1.
+static int appendValueFields(uint8_t* descriptor, int size, const uint8_t* usages, const uint8_t* bits, uint8_t count, uint16_t& valueBits)
+{
+	uint8_t first = 0;
+	while (first < count) {
+		uint8_t fieldSize = fieldBits(bits[first]);
+		uint8_t last = first + 1;
+		while (last < count && fieldBits(bits[last]) == fieldSize) {
+			last++;
+		}
+		int16_t limit = (int16_t)((1L << (fieldSize - 1)) - 1);
+
+		// LOGICAL_MINIMUM (-limit)
+		descriptor[size++] = 0x16;
+		descriptor[size++] = lowByte(-limit);
+		descriptor[size++] = highByte(-limit);
+
+		// LOGICAL_MAXIMUM (+limit)
+		descriptor[size++] = 0x26;
+		descriptor[size++] = lowByte(limit);
+		descriptor[size++] = highByte(limit);
+
+		// REPORT_SIZE (fieldSize)
+		descriptor[size++] = 0x75;
+		descriptor[size++] = fieldSize;
+
+		// REPORT_COUNT (values in this run)
+		descriptor[size++] = 0x95;
+		descriptor[size++] = last - first;
+
+		for (uint8_t index = first; index < last; index++) {
+			// USAGE
+			descriptor[size++] = 0x09;
+			descriptor[size++] = usages[index];
+		}
+
+		// INPUT (Data,Var,Abs)
+		descriptor[size++] = 0x81;
+		descriptor[size++] = 0x02;
+
+		valueBits += (uint16_t)fieldSize * (last - first);
+		first = last;
+	}
+	return size;
+}
+
 Joystick_::Joystick_(
 	uint8_t hidReportId,
 	uint8_t joystickType,
@@ -56,13 +124,44 @@ Joystick_::Joystick_(
 	bool includeThrottle,
 	bool includeAccelerator,
 	bool includeBrake,
-	bool includeSteering)
+	bool includeSteering,
+	uint8_t includeForceFeedback,
+	const JoystickBitDepths& bitDepths)
 {
     // Set the USB HID Report ID
     _hidReportId = hidReportId;
 
+	// Force feedback takes report IDs hidReportId..hidReportId + PID_REPORT_ID_COUNT - 1.
+	// The joystick goes without it if that range is invalid or in use, or if the
+	// PID handler does not fit in RAM.
+	// An earlier joystick whose PID report range holds this joystick's input
+	// report ID gives up its force feedback, so both joysticks keep working.
+	static Joystick_* lastJoystick = NULL;
+	for (Joystick_* earlier = lastJoystick; earlier != NULL; earlier = earlier->_previousJoystick) {
+		if (earlier->m_pid_report_handler &&
+			hidReportId > earlier->_hidReportId &&
+			hidReportId < earlier->_hidReportId + PID_REPORT_ID_COUNT) {
+			earlier->dropForceFeedback();
+		}
+	}
+	_previousJoystick = lastJoystick;
+	lastJoystick = this;
+	static bool firstJoystick = true;
+	if (includeForceFeedback == JOYSTICK_FFB_FIRST_ONLY) {
+		includeForceFeedback = firstJoystick;
+	}
+	firstJoystick = false;
+	if (includeForceFeedback) {
+		if (hidReportId >= 1 && hidReportId <= 256 - PID_REPORT_ID_COUNT &&
+			DynamicHID().reportIdsFree(hidReportId, hidReportId + PID_REPORT_ID_COUNT - 1)) {
+			m_pid_report_handler = new PIDReportHandler();
+		}
+		includeForceFeedback = m_pid_report_handler != NULL;
+	}
+
     // Save Joystick Settings
     _buttonCount = buttonCount;
+	_bitDepths = bitDepths;
 	_hatSwitchCount = hatSwitchCount;
 	_includeAxisFlags = 0;
 	_includeAxisFlags |= (includeXAxis ? JOYSTICK_INCLUDE_X_AXIS : 0);
@@ -102,7 +201,10 @@ Joystick_::Joystick_(
 		+ (includeBrake == true)
 		+ (includeSteering == true); 
 		
-	static uint8_t tempHidReportDescriptor[150];
+	// Axis and simulation values, packed at their bit depths
+	uint16_t valueBits = 0;
+
+	static uint8_t tempHidReportDescriptor[JOYSTICK_DESCRIPTOR_BUFFER_SIZE];
 	int hidReportDescriptorSize = 0;
 
     // USAGE_PAGE (Generic Desktop)
@@ -121,7 +223,7 @@ Joystick_::Joystick_(
 	tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
     // REPORT_ID (Default: 1)
     tempHidReportDescriptor[hidReportDescriptorSize++] = 0x85;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+    tempHidReportDescriptor[hidReportDescriptorSize++] = _hidReportId;
 
 	// COLLECTION (Physical)
 	tempHidReportDescriptor[hidReportDescriptorSize++] = 0xa1;
@@ -298,67 +400,51 @@ Joystick_::Joystick_(
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
 
-		// LOGICAL_MINIMUM (-32767)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x16;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x80;
-
-		// LOGICAL_MAXIMUM (+32767)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x26;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7F;
-
-		// REPORT_SIZE (16)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x10;
-
-		// REPORT_COUNT (axisCount)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = axisCount;
-						
 		// COLLECTION (Physical)
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0xA1;
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
 
+		uint8_t usages[6];
+		uint8_t bits[6];
+		uint8_t fieldCount = 0;
+
 		if (includeXAxis == true) {
 			// USAGE (X)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x30;
+			usages[fieldCount] = 0x30;
+			bits[fieldCount++] = _bitDepths.x;
 		}
 
 		if (includeYAxis == true) {
 			// USAGE (Y)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x31;
+			usages[fieldCount] = 0x31;
+			bits[fieldCount++] = _bitDepths.y;
 		}
 		
 		if (includeZAxis == true) {
 			// USAGE (Z)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x32;
+			usages[fieldCount] = 0x32;
+			bits[fieldCount++] = _bitDepths.z;
 		}
 		
 		if (includeRxAxis == true) {
 			// USAGE (Rx)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x33;
+			usages[fieldCount] = 0x33;
+			bits[fieldCount++] = _bitDepths.rx;
 		}
 		
 		if (includeRyAxis == true) {
 			// USAGE (Ry)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x34;
+			usages[fieldCount] = 0x34;
+			bits[fieldCount++] = _bitDepths.ry;
 		}
 		
 		if (includeRzAxis == true) {
 			// USAGE (Rz)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x35;
+			usages[fieldCount] = 0x35;
+			bits[fieldCount++] = _bitDepths.rz;
 		}
 		
-		// INPUT (Data,Var,Abs)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
+		hidReportDescriptorSize = appendValueFields(tempHidReportDescriptor, hidReportDescriptorSize, usages, bits, fieldCount, valueBits);
 		
 		// END_COLLECTION (Physical)
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
@@ -370,75 +456,90 @@ Joystick_::Joystick_(
 		// USAGE_PAGE (Simulation Controls)
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-		
-		// LOGICAL_MINIMUM (-32767)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x16;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x80;
-
-		// LOGICAL_MAXIMUM (+32767)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x26;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7F;
-
-		// REPORT_SIZE (16)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x10;
-
-		// REPORT_COUNT (simulationCount)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = simulationCount;
 
 		// COLLECTION (Physical)
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0xA1;
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
 
+		uint8_t usages[5];
+		uint8_t bits[5];
+		uint8_t fieldCount = 0;
+
 		if (includeRudder == true) {
 			// USAGE (Rudder)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0xBA;
+			usages[fieldCount] = 0xBA;
+			bits[fieldCount++] = _bitDepths.rudder;
 		}
 
 		if (includeThrottle == true) {
 			// USAGE (Throttle)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0xBB;
+			usages[fieldCount] = 0xBB;
+			bits[fieldCount++] = _bitDepths.throttle;
 		}
 
 		if (includeAccelerator == true) {
 			// USAGE (Accelerator)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0xC4;
+			usages[fieldCount] = 0xC4;
+			bits[fieldCount++] = _bitDepths.accelerator;
 		}
 
 		if (includeBrake == true) {
 			// USAGE (Brake)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0xC5;
+			usages[fieldCount] = 0xC5;
+			bits[fieldCount++] = _bitDepths.brake;
 		}
 
 		if (includeSteering == true) {
 			// USAGE (Steering)
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-			tempHidReportDescriptor[hidReportDescriptorSize++] = 0xC8;
+			usages[fieldCount] = 0xC8;
+			bits[fieldCount++] = _bitDepths.steering;
 		}
 
-		// INPUT (Data,Var,Abs)
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
+		hidReportDescriptorSize = appendValueFields(tempHidReportDescriptor, hidReportDescriptorSize, usages, bits, fieldCount, valueBits);
 		
 		// END_COLLECTION (Physical) 
 		tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
 	} // Simulation Controls
 
+	if ((valueBits % 8) > 0) {
+
+		// Pad the packed values to a whole byte
+
+		// REPORT_SIZE (1)
+		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
+		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+
+		// REPORT_COUNT (# of padding bits)
+		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
+		tempHidReportDescriptor[hidReportDescriptorSize++] = 8 - (valueBits % 8);
+
+		// INPUT (Const,Var,Abs)
+		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
+		tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
+
+	} // Padding Bits Needed
+
     // END_COLLECTION
     tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
 
+	if (!includeForceFeedback) {
+		// END_COLLECTION (Application), otherwise closed by the PID descriptor
+		tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
+	}
+
 	// Create a copy of the HID Report Descriptor template that is just the right size
 	uint8_t *customHidReportDescriptor = new uint8_t[hidReportDescriptorSize];
 	memcpy(customHidReportDescriptor, tempHidReportDescriptor, hidReportDescriptorSize);
 	// Register HID Report Description
-	DynamicHIDSubDescriptor* node = new DynamicHIDSubDescriptor(customHidReportDescriptor, hidReportDescriptorSize,pidReportDescriptor, pidReportDescriptorSize, false);
+	// The PID reports of this joystick take report IDs hidReportId..hidReportId + 13,
+	// so joysticks with force feedback need report IDs at least 14 apart.
+	DynamicHIDSubDescriptor* node;
+	if (includeForceFeedback) {
+		node = new DynamicHIDSubDescriptor(customHidReportDescriptor, hidReportDescriptorSize, pidReportDescriptor, pidReportDescriptorSize, false,
+		                                   m_pid_report_handler, _hidReportId - 1);
+	} else {
+		node = new DynamicHIDSubDescriptor(customHidReportDescriptor, hidReportDescriptorSize, NULL, 0, false);
+	}
 	
 	DynamicHID().AppendDescriptor(node);
 	
@@ -454,8 +555,15 @@ Joystick_::Joystick_(
 	// Calculate HID Report Size
 	_hidReportSize = _buttonValuesArraySize;
 	_hidReportSize += (_hatSwitchCount > 0);
-	_hidReportSize += (axisCount * 2);
-	_hidReportSize += (simulationCount * 2);
+	_hidReportSize += (valueBits + 7) / 8;
+
+	// Input report cache, GET_REPORT and idle repeats are served from it
+	_hidReport = new uint8_t[_hidReportSize + 1];
+	memset(_hidReport, 0, _hidReportSize + 1);
+	_hidReport[0] = _hidReportId;
+	node->inputReport = _hidReport;
+	node->inputReportLength = _hidReportSize + 1;
+	_hidNode = node;
 	
 	// Initalize Joystick State
 	_xAxis = 0;
@@ -479,6 +587,23 @@ Joystick_::Joystick_(
     }
 }
 
+void Joystick_::dropForceFeedback()
+{
+	DynamicHID().RemovePIDReports(_hidNode);
+	delete m_pid_report_handler;
+	m_pid_report_handler = NULL;
+}
+
+void Joystick_::getMemoryUsage(JoystickMemoryUsage& usage)
+{
+	usage.joystick = sizeof(Joystick_);
+	usage.pidHandler = m_pid_report_handler ? sizeof(PIDReportHandler) : 0;
+	usage.effectStates = m_pid_report_handler ? sizeof(m_pid_report_handler->g_EffectStates) : 0;
+	usage.descriptor = _hidNode->length;
+	usage.reports = _buttonValuesArraySize + _hidReportSize + 1 + sizeof(DynamicHIDSubDescriptor);
+	usage.shared = JOYSTICK_SHARED_RAM;
+}
+
 void Joystick_::begin(bool initAutoSendState)
 {
 	_autoSendState = initAutoSendState;
@@ -498,115 +623,343 @@ void Joystick_::EnableAutoCenter(int16_t coefficient, int16_t saturation)
 	effect.conditions[0].negativeSaturation = saturation;
 	effect.conditions[0].deadBand = 0;
 	effect.duration = 0;
-	DynamicHID().pidReportHandler.EnableDefaultEffect(effect);
+	if (m_pid_report_handler) {
+		m_pid_report_handler->EnableDefaultEffect(effect);
+	}
 }
 
 void Joystick_::getForce(int32_t* forces) {
 	DynamicHID().RecvfromUsb();
+	if (!m_pid_report_handler) {
+		for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+			forces[axis] = 0;
+		return;
+	}
+#if FFB_TELEMETRY
+	unsigned long start = micros();
+#endif
 	forceCalculator(forces);
+	sendPIDState();
+#if FFB_TELEMETRY
+	sendTelemetry(forces, start);
+#endif
 }
 
-int32_t Joystick_::getEffectForce(volatile TEffectState& effect, Gains _gains, EffectParams _effect_params, uint8_t axis){
-	uint8_t direction;
-    uint8_t condition;
-	bool useForceDirectionForConditionEffect = (effect.enableAxis == DIRECTION_ENABLE && effect.conditionBlocksCount == 1);
+void Joystick_::sendPIDState()
+{
+	// Only use the IN endpoint when it is free, so joystick input reports are never held up.
+	const int len = sizeof(USB_FFBReport_PIDStatus_Input_Data_t) - 1;
+	if (!m_pid_report_handler->PIDStateReportDue() || !DynamicHID().usb_CanSend(len))
+		return;
+	uint8_t* report = m_pid_report_handler->PopPIDState();
+	// PID State is report 2 of this joystick's PID report ID range.
+	DynamicHID().SendReport(_hidReportId + 1, report + 1, len);
+}
 
-    if (effect.enableAxis == DIRECTION_ENABLE)
-    {
-        direction = effect.directionX;
-		if (effect.conditionBlocksCount > 1) {
-            condition = axis;
-        } else {
-	        condition = 0; // only one Condition Parameter Block is defined
+#if FFB_TELEMETRY
+void Joystick_::sendTelemetry(const int32_t* forces, unsigned long start)
+{
+	unsigned long calcTime = micros() - start;
+	unsigned long loopTime = start - m_telemetry_last_start;
+	m_telemetry_last_start = start;
+	if (m_telemetry_decimation == 0 || ++m_telemetry_countdown < m_telemetry_decimation)
+		return;
+	m_telemetry_countdown = 0;
+
+	FFBTelemetry_Input_Data_t& frame = m_telemetry;
+	// Telemetry is report 9 of this joystick's PID report ID range.
+	frame.reportId = _hidReportId - 1 + FFB_TELEMETRY_REPORT_ID;
+	frame.sequence++;
+	frame.time = m_frame_time;
+	frame.loopTime = min(loopTime, 0xFFFFUL);
+	frame.calcTime = min(calcTime, 0xFFFFUL);
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+		frame.force[axis] = constrain(forces[axis], -32767, 32767);
+
+	// The next playing effect after the one in the previous frame
+	uint8_t previous = frame.effectId;
+	frame.effectId = 0;
+	const uint16_t playing = m_pid_report_handler->playingEffects;
+	for (uint8_t i = 1; playing && i <= MAX_EFFECTS; i++)
+	{
+		uint8_t id = (previous + i - 1) % MAX_EFFECTS + 1;
+		volatile TEffectState& effect = m_pid_report_handler->g_EffectStates[id];
+		if (playing & (1u << id))
+		{
+			frame.effectId = id;
+			for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+				frame.effectForce[axis] = constrain(effect.forceCache[axis], -32767, 32767);
+			break;
 		}
-    }
-    else
-    {
-        direction = axis == 0 ? effect.directionX : effect.directionY;
-        condition = axis;
-    }
+	}
+	if (frame.effectId == 0)
+		memset(frame.effectForce, 0, sizeof(frame.effectForce));
 
-    float angle = (direction * 360.0 / 255.0) * DEG_TO_RAD;
-    float angle_ratio = axis == 0 ? sin(angle) : -1 * cos(angle);
-	int32_t force = 0;
-	switch (effect.effectType)
-    {
-	    case USB_EFFECT_CONSTANT://1
-	        force = ConstantForceCalculator(effect) * _gains.constantGain * angle_ratio;
-	        break;
-	    case USB_EFFECT_RAMP://2
-	    	force = RampForceCalculator(effect) * _gains.rampGain * angle_ratio;
-	    	break;
-	    case USB_EFFECT_SQUARE://3
-	    	force = SquareForceCalculator(effect) * _gains.squareGain * angle_ratio;
-	    	break;
-	    case USB_EFFECT_SINE://4
-	    	force = SinForceCalculator(effect) * _gains.sineGain * angle_ratio;
-	    	break;
-	    case USB_EFFECT_TRIANGLE://5
-	    	force = TriangleForceCalculator(effect) * _gains.triangleGain * angle_ratio;
-	    	break;
-	    case USB_EFFECT_SAWTOOTHDOWN://6
-	    	force = SawtoothDownForceCalculator(effect) * _gains.sawtoothdownGain * angle_ratio;
-	    	break;
-	    case USB_EFFECT_SAWTOOTHUP://7
-	    	force = SawtoothUpForceCalculator(effect) * _gains.sawtoothupGain * angle_ratio;
-	    	break;
-	    case USB_EFFECT_SPRING://8
-	    	force = ConditionForceCalculator(effect, NormalizeRange(_effect_params.springPosition, _effect_params.springMaxPosition), condition) * _gains.springGain;
-	    	if (useForceDirectionForConditionEffect) {
-				force *= angle_ratio;
-			}
-			break;
-	    case USB_EFFECT_DAMPER://9
-	    	force = ConditionForceCalculator(effect, NormalizeRange(_effect_params.damperVelocity, _effect_params.damperMaxVelocity), condition) * _gains.damperGain;
-	    	if (useForceDirectionForConditionEffect) {
-				force *= angle_ratio;
+	frame.metricsAxis = (frame.metricsAxis + 1) % MAX_FFB_AXIS_COUNT;
+	if (m_effect_params)
+	{
+		const EffectParams& params = m_effect_params[frame.metricsAxis];
+		frame.springPosition = params.springPosition;
+		frame.damperVelocity = params.damperVelocity;
+		frame.inertiaAcceleration = params.inertiaAcceleration;
+		frame.frictionPositionChange = params.frictionPositionChange;
+	}
+
+	// Dropped rather than waited for when the IN endpoint is busy
+	const int len = FFB_TELEMETRY_REPORT_SIZE - 1;
+	if (DynamicHID().usb_CanSend(len))
+		DynamicHID().SendReport(frame.reportId, (uint8_t*)&frame + 1, len);
+}
+#endif
+
+// Periodic, constant and ramp effects: the force is computed a single time
+// and distributed along effect.axisProjection, see updateEffectGain().
+template <int32_t (Joystick_::*calculator)(volatile TEffectState&)>
+void Joystick_::directedForce(volatile TEffectState& effect, int32_t* forces)
+{
+	int32_t force = (this->*calculator)(effect);
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		forces[axis] += (((force * effect.axisGain[axis]) >> 15) * effect.axisProjection[axis]) >> 15;
+	}
+}
+
+// Condition effects depend on each axis' own metric and parameter block.
+template <uint8_t effectType>
+void Joystick_::conditionForce(volatile TEffectState& effect, int32_t* forces)
+{
+	const uint8_t conditionAxes = effect.conditionAxes;
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		if (!(conditionAxes & (1 << axis))) {
+			continue;
+		}
+		uint8_t condition = (conditionAxes & CONDITION_SHARED_BLOCK) ? 0 : axis;
+		EffectParams& params = m_effect_params[axis];
+		int32_t axisForce = 0;
+		if (effectType == USB_EFFECT_SPRING) {
+			axisForce = ConditionForceCalculator(effect, NormalizeRange(params.springPosition, params.springMaxPosition), condition);
+		}
+		else if (effectType == USB_EFFECT_DAMPER) {
+			axisForce = ConditionForceCalculator(effect, NormalizeRange(params.damperVelocity, params.damperMaxVelocity), condition);
+		}
+		else if (effectType == USB_EFFECT_INERTIA) {
+			if (params.inertiaAcceleration < 0 && params.frictionPositionChange < 0) {
+				axisForce = ConditionForceCalculator(effect, abs(NormalizeRange(params.inertiaAcceleration, params.inertiaMaxAcceleration)), condition);
 			}
-			break;
-	    case USB_EFFECT_INERTIA://10
-	    	if (_effect_params.inertiaAcceleration < 0 && _effect_params.frictionPositionChange < 0) {
-	    		force = ConditionForceCalculator(effect, abs(NormalizeRange(_effect_params.inertiaAcceleration, _effect_params.inertiaMaxAcceleration)), condition) * _gains.inertiaGain;
-	    	}
-	    	else if (_effect_params.inertiaAcceleration < 0 && _effect_params.frictionPositionChange > 0) {
-	    		force = -1 * ConditionForceCalculator(effect, abs(NormalizeRange(_effect_params.inertiaAcceleration, _effect_params.inertiaMaxAcceleration)), condition) * _gains.inertiaGain;
-	    	}
-			if (useForceDirectionForConditionEffect) {
-				force *= angle_ratio;
+			else if (params.inertiaAcceleration < 0 && params.frictionPositionChange > 0) {
+				axisForce = -1 * ConditionForceCalculator(effect, abs(NormalizeRange(params.inertiaAcceleration, params.inertiaMaxAcceleration)), condition);
 			}
-	    	break;
-	    case USB_EFFECT_FRICTION://11
-	    		force = ConditionForceCalculator(effect, NormalizeRange(_effect_params.frictionPositionChange, _effect_params.frictionMaxPositionChange), condition) * _gains.frictionGain;
-	    		if (useForceDirectionForConditionEffect) {
-				    force *= angle_ratio;
-			    }
-				break;
-	    case USB_EFFECT_CUSTOM://12
-	    		break;
-	    }
-	    effect.elapsedTime = (uint64_t)millis() - effect.startTime;
-		return force;
+		}
+		else {
+			axisForce = ConditionForceCalculator(effect, NormalizeRange(params.frictionPositionChange, params.frictionMaxPositionChange), condition);
+		}
+		axisForce = (axisForce * effect.axisGain[axis]) >> 15;
+		if (conditionAxes & CONDITION_PROJECTED) {
+			axisForce = (axisForce * effect.axisProjection[axis]) >> 15;
+		}
+		forces[axis] += axisForce;
+	}
+}
+
+const Joystick_::EffectForceRoutine Joystick_::effectForceRoutines[USB_EFFECT_FRICTION + 1] PROGMEM = {
+	&Joystick_::noForce,	// 0, also custom and unknown types
+	&Joystick_::directedForce<&Joystick_::ConstantForceCalculator>,	// 1
+	&Joystick_::directedForce<&Joystick_::RampForceCalculator>,	// 2
+	&Joystick_::directedForce<&Joystick_::SquareForceCalculator>,	// 3
+	&Joystick_::directedForce<&Joystick_::SinForceCalculator>,	// 4
+	&Joystick_::directedForce<&Joystick_::TriangleForceCalculator>,	// 5
+	&Joystick_::directedForce<&Joystick_::SawtoothDownForceCalculator>,	// 6
+	&Joystick_::directedForce<&Joystick_::SawtoothUpForceCalculator>,	// 7
+	&Joystick_::conditionForce<USB_EFFECT_SPRING>,	// 8
+	&Joystick_::conditionForce<USB_EFFECT_DAMPER>,	// 9
+	&Joystick_::conditionForce<USB_EFFECT_INERTIA>,	// 10
+	&Joystick_::conditionForce<USB_EFFECT_FRICTION>,	// 11
+};
+
+// Calls the force routine updateEffectGain() bound to the effect, no type dispatch per tick
+void Joystick_::getEffectForce(volatile TEffectState& effect, int32_t* forces){
+	EffectForceRoutine routine;
+	memcpy_P(&routine, &effectForceRoutines[effect.forceRoutine], sizeof(routine));
+	(this->*routine)(effect, forces);
+}
+
+// True when the effect gives the same contribution every tick as long as its
+// parameters and, for condition effects, the axis metrics stay the same.
+static bool isTimeInvariant(volatile TEffectState& effect)
+{
+	switch (effect.effectType)
+	{
+		case USB_EFFECT_CONSTANT:
+		{
+			// Outside the attack and fade phases of ApplyEnvelope
+			unsigned long elapsedTime = effect.elapsedTime;
+			int32_t duration = effect.duration;
+			return elapsedTime >= effect.attackTime &&
+				(duration == USB_DURATION_INFINITE || (int32_t)elapsedTime <= duration - (int32_t)effect.fadeTime);
+		}
+		case USB_EFFECT_SPRING:
+		case USB_EFFECT_DAMPER:
+		case USB_EFFECT_INERTIA:
+		case USB_EFFECT_FRICTION:
+			return true;
+	}
+	return false;
+}
+
+// Returns a bit per condition effect type (effectType - USB_EFFECT_SPRING)
+// whose metric moved on any axis since the last call.
+uint8_t Joystick_::changedConditionMetrics()
+{
+	uint8_t changed = 0;
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		EffectParams& params = m_effect_params[axis];
+		EffectParams& last = m_last_effect_params[axis];
+		if (params.springPosition != last.springPosition || params.springMaxPosition != last.springMaxPosition)
+			changed |= 1 << (USB_EFFECT_SPRING - USB_EFFECT_SPRING);
+		if (params.damperVelocity != last.damperVelocity || params.damperMaxVelocity != last.damperMaxVelocity)
+			changed |= 1 << (USB_EFFECT_DAMPER - USB_EFFECT_SPRING);
+		if (params.inertiaAcceleration != last.inertiaAcceleration || params.inertiaMaxAcceleration != last.inertiaMaxAcceleration ||
+			params.frictionPositionChange != last.frictionPositionChange)
+			changed |= 1 << (USB_EFFECT_INERTIA - USB_EFFECT_SPRING);
+		if (params.frictionPositionChange != last.frictionPositionChange || params.frictionMaxPositionChange != last.frictionMaxPositionChange)
+			changed |= 1 << (USB_EFFECT_FRICTION - USB_EFFECT_SPRING);
+		last = params;
+	}
+	return changed;
+}
+
+static uint8_t Gains::* effectTypeGain(uint8_t effectType)
+{
+	switch (effectType)
+	{
+		case USB_EFFECT_CONSTANT: return &Gains::constantGain;
+		case USB_EFFECT_RAMP: return &Gains::rampGain;
+		case USB_EFFECT_SQUARE: return &Gains::squareGain;
+		case USB_EFFECT_SINE: return &Gains::sineGain;
+		case USB_EFFECT_TRIANGLE: return &Gains::triangleGain;
+		case USB_EFFECT_SAWTOOTHDOWN: return &Gains::sawtoothdownGain;
+		case USB_EFFECT_SAWTOOTHUP: return &Gains::sawtoothupGain;
+		case USB_EFFECT_SPRING: return &Gains::springGain;
+		case USB_EFFECT_DAMPER: return &Gains::damperGain;
+		case USB_EFFECT_INERTIA: return &Gains::inertiaGain;
+		case USB_EFFECT_FRICTION: return &Gains::frictionGain;
+		case USB_EFFECT_CUSTOM: return &Gains::customGain;
+	}
+	return NULL;
+}
+
+void Joystick_::updateEffectGain(volatile TEffectState& effect)
+{
+	// effect.gain and the device gain are 0..255, the Gains entries 0..FORCE_FEEDBACK_MAXGAIN
+	uint8_t Gains::* typeGain = effectTypeGain(effect.effectType);
+	uint32_t gain = (uint32_t)effect.gain * m_pid_report_handler->deviceGain.gain * 0x8000 / (255UL * 255);
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		uint32_t axisGain = 0;
+		if (typeGain != NULL)
+		{
+			axisGain = gain * m_gains[axis].totalGain * m_gains[axis].*typeGain
+				/ ((uint32_t)FORCE_FEEDBACK_MAXGAIN * FORCE_FEEDBACK_MAXGAIN);
+		}
+		effect.axisGain[axis] = axisGain > 0xFFFF ? 0xFFFF : axisGain;
+	}
+
+	// Projection of the effect's direction onto each axis, so no effect
+	// needs sin() or cos() while it plays.
+	bool directionEnabled = (effect.enableAxis & DIRECTION_ENABLE) != 0;
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		float ratio = 0;
+		if (directionEnabled)
+		{
+			// Polar direction is a 2-D angle in the X/Y plane: only the first
+			// direction instance is used and axes past Y get no force.
+			float angle = (effect.direction[0] * 360.0 / 255.0) * DEG_TO_RAD;
+			ratio = axis == 0 ? sin(angle) : (axis == 1 ? -1 * cos(angle) : 0);
+		}
+		else if (effect.enableAxis & (1 << axis))
+		{
+			// Cartesian: each enabled axis takes its own direction instance.
+			// X uses sin(), every other axis -cos() like Y, so a direction
+			// of 0 pushes X by 0 and the other axes fully negative.
+			float angle = (effect.direction[axis] * 360.0 / 255.0) * DEG_TO_RAD;
+			ratio = axis == 0 ? sin(angle) : -1 * cos(angle);
+		}
+		effect.axisProjection[axis] = (int16_t)(ratio * 0x7FFF);
+	}
+
+	// Force routine and, for condition effects, the axes and blocks it uses
+	effect.forceRoutine = effect.effectType <= USB_EFFECT_FRICTION ? effect.effectType : 0;
+	uint8_t conditionAxes = (1 << MAX_FFB_AXIS_COUNT) - 1;
+	if (!directionEnabled)
+		conditionAxes &= effect.enableAxis;
+	else if (effect.conditionBlocksCount <= 1)
+		conditionAxes |= CONDITION_SHARED_BLOCK | (effect.conditionBlocksCount == 1 ? CONDITION_PROJECTED : 0);
+	effect.conditionAxes = conditionAxes;
 }
 
 
 void Joystick_::forceCalculator(int32_t* forces) {
-	forces[0] = 0;
-    forces[1] = 0;
-	    for (int id = 1; id < MAX_EFFECTS; id++) {
-	    	volatile TEffectState& effect = DynamicHID().pidReportHandler.g_EffectStates[id];
-	    	if ((effect.state == MEFFECTSTATE_PLAYING) &&
-	    		((effect.elapsedTime <= effect.duration) ||
-	    		(effect.duration == USB_DURATION_INFINITE)) &&
-	    		!DynamicHID().pidReportHandler.devicePaused)
+	FFB_PROFILE_BEGIN(start);
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		forces[axis] = 0;
+	}
+	const uint8_t metricsChanged = changedConditionMetrics();
+	// One timestamp per frame, every effect of this tick sees the same time
+	const unsigned long now = m_pid_report_handler->clock();
+	m_frame_time = now;
+	// Only the playing effects are visited, in id order
+	uint16_t playing = m_pid_report_handler->devicePaused ? 0 : m_pid_report_handler->playingEffects;
+	    for (uint8_t id = 1; (playing >> id) != 0; id++) {
+	    	volatile TEffectState& effect = m_pid_report_handler->g_EffectStates[id];
+	    	if (playing & (1u << id))
 	    	{
-				forces[0] += (int32_t)(getEffectForce(effect, m_gains[0], m_effect_params[0], 0));
-				forces[1] += (int32_t)(getEffectForce(effect, m_gains[1], m_effect_params[1], 1));
+	    		// Unsigned subtraction stays right across the wrap of millis().
+	    		// An effect started after now (negative as long) has not begun.
+	    		const unsigned long elapsed = (unsigned long)(now - effect.startTime);
+	    		effect.elapsedTime = (long)elapsed < 0 ? 0 : elapsed;
+	    		if ((effect.elapsedTime > effect.duration) &&
+	    			(effect.duration != USB_DURATION_INFINITE))
+	    		{
+	    			// Finished playing, let the host know through the PID State report.
+	    			m_pid_report_handler->StopEffect(id);
+	    			continue;
+	    		}
+				const uint16_t bit = 1u << id;
+				if (m_pid_report_handler->effectGainsDirty & bit)
+				{
+					m_pid_report_handler->effectGainsDirty &= ~bit;
+					m_pid_report_handler->effectForcesValid &= ~bit;
+					updateEffectGain(effect);
+				}
+				if (effect.effectType >= USB_EFFECT_SPRING && effect.effectType <= USB_EFFECT_FRICTION &&
+					(metricsChanged & (1 << (effect.effectType - USB_EFFECT_SPRING))))
+				{
+					m_pid_report_handler->effectForcesValid &= ~bit;
+				}
+				if (!(m_pid_report_handler->effectForcesValid & bit) || !isTimeInvariant(effect))
+				{
+					FFB_PROFILE_BEGIN(effectStart);
+					int32_t contribution[MAX_FFB_AXIS_COUNT] = {0};
+					getEffectForce(effect, contribution);
+					for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+						effect.forceCache[axis] = contribution[axis];
+					if (isTimeInvariant(effect))
+						m_pid_report_handler->effectForcesValid |= bit;
+					FFB_PROFILE_END(FFB_STAGE_EFFECT_TYPE(effect.effectType), effectStart);
+				}
+				for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+					forces[axis] += effect.forceCache[axis];
 	    	}
 	    }
-	forces[0] = (int32_t)((float)1.0 * forces[0] * m_gains[0].totalGain / 10000); // each effect gain * total effect gain = 10000
-	forces[1] = (int32_t)((float)1.0 * forces[1] * m_gains[1].totalGain / 10000); // each effect gain * total effect gain = 10000
-	forces[0] = map(forces[0], -10000, 10000, -255, 255);
-	forces[1] = map(forces[1], -10000, 10000, -255, 255);
+	for (uint8_t axis = 0; axis < MAX_FFB_AXIS_COUNT; axis++)
+	{
+		forces[axis] = map(forces[axis], -10000, 10000, -255, 255);
+	}
+	FFB_PROFILE_END(FFB_STAGE_FORCE, start);
 }
 
 int32_t Joystick_::ConstantForceCalculator(volatile TEffectState& effect) 
@@ -620,22 +973,23 @@ int32_t Joystick_::RampForceCalculator(volatile TEffectState& effect)
 	return ApplyEnvelope(effect, tempforce);
 }
 
+// Position in the effect's cycle, 0..0xFFFF for one period, from the phase
+// accumulator PIDReportHandler::UpdatePhase() set up. The uint32_t product
+// wraps at the end of each period, so no modulo is needed, and elapsedTime
+// is kept at full width so the phase does not jump when it would wrap.
+static uint16_t cyclePosition(volatile TEffectState& effect)
+{
+	uint32_t position = (uint32_t)effect.elapsedTime * effect.phaseStep + ((uint32_t)effect.phaseStart << 16);
+	return position >> 16;
+}
+
 int32_t Joystick_::SquareForceCalculator(volatile TEffectState& effect)
 {
-	int16_t offset = effect.offset * 2;
-	int16_t magnitude = effect.magnitude;
-	uint16_t phase = effect.phase;
-	uint16_t elapsedTime = effect.elapsedTime;
-	uint16_t period = effect.period;
+	int32_t offset = effect.offset * 2;
+	int32_t magnitude = effect.magnitude;
 
-	int32_t maxMagnitude = offset + magnitude;
-	int32_t minMagnitude = offset - magnitude;
-	uint32_t phasetime = (phase * period) / 255;
-	uint32_t timeTemp = elapsedTime + phasetime;
-	uint32_t reminder = timeTemp % period;
-	int32_t tempforce;
-	if (reminder > (period / 2)) tempforce = minMagnitude;
-	else tempforce = maxMagnitude;
+	// Max for the first half of the period, min for the second
+	int32_t tempforce = cyclePosition(effect) < 0x8000 ? offset + magnitude : offset - magnitude;
 	return ApplyEnvelope(effect, tempforce);
 }
 
@@ -643,12 +997,7 @@ int32_t Joystick_::SinForceCalculator(volatile TEffectState& effect)
 {
 	int16_t offset = effect.offset * 2;
 	int16_t magnitude = effect.magnitude;
-	uint16_t phase = effect.phase;
-	uint16_t timeTemp = effect.elapsedTime;
-	uint16_t period = effect.period;
-	float angle = 0.0;
-	if(period != 0)
-		angle = ((timeTemp * 1.0 / period) * 2 * PI + (phase / 36000.0));
+	float angle = cyclePosition(effect) * (2 * PI / 65536.0);
 	float sine = sin(angle);
 	int32_t tempforce = (int32_t)(sine * magnitude);
 	tempforce += offset;
@@ -657,65 +1006,38 @@ int32_t Joystick_::SinForceCalculator(volatile TEffectState& effect)
 
 int32_t Joystick_::TriangleForceCalculator(volatile TEffectState& effect)
 {
-	int16_t offset = effect.offset * 2;
-	int16_t magnitude = effect.magnitude;
-	uint16_t elapsedTime = effect.elapsedTime;
-	uint16_t phase = effect.phase;
-	uint16_t period = effect.period;
-	uint16_t periodF = effect.period;
-
-	int16_t maxMagnitude = offset + magnitude;
-	int16_t minMagnitude = offset - magnitude;
-	int32_t phasetime = (phase * period) / 255;
-	uint32_t timeTemp = elapsedTime + phasetime;
-	int32_t reminder = timeTemp % period;
-	int32_t slope = ((maxMagnitude - minMagnitude) * 2) / periodF;
-	int32_t tempforce = 0;
-	if (reminder > (periodF / 2)) tempforce = slope * (periodF - reminder);
-	else tempforce = slope * reminder;
-	tempforce += minMagnitude;
+	int32_t offset = effect.offset * 2;
+	int32_t magnitude = effect.magnitude;
+	int32_t minMagnitude = offset - magnitude;
+
+	// Rises from min to max over the first half of the period, 0..0x8000
+	uint16_t position = cyclePosition(effect);
+	int32_t ramp = position < 0x8000 ? position : 0x10000L - position;
+	int32_t tempforce = minMagnitude + ((magnitude * 2 * ramp) >> 15);
 	return ApplyEnvelope(effect, tempforce);
 }
 
 int32_t Joystick_::SawtoothDownForceCalculator(volatile TEffectState& effect) 
 {
-	int16_t offset = effect.offset * 2;
-	int16_t magnitude = effect.magnitude;
-	uint16_t elapsedTime = effect.elapsedTime;
-	uint16_t phase = effect.phase;
-	uint16_t period = effect.period;
-	uint16_t periodF = effect.period;
-
-	int16_t maxMagnitude = offset + magnitude;
-	int16_t minMagnitude = offset - magnitude;
-	int32_t phasetime = (phase * period) / 255;
-	uint32_t timeTemp = elapsedTime + phasetime;
-	int32_t reminder = timeTemp % period;
-	int32_t slope = (maxMagnitude - minMagnitude) / periodF;
-	int32_t tempforce = 0;
-	tempforce = slope * (period - reminder);
-	tempforce += minMagnitude;
+	int32_t offset = effect.offset * 2;
+	int32_t magnitude = effect.magnitude;
+	int32_t minMagnitude = offset - magnitude;
+
+	// From max at the start of the period down to min, 0x8000..1
+	int32_t ramp = 0x8000L - (cyclePosition(effect) >> 1);
+	int32_t tempforce = minMagnitude + ((magnitude * 2 * ramp) >> 15);
 	return ApplyEnvelope(effect, tempforce);
 }
 
 int32_t Joystick_::SawtoothUpForceCalculator(volatile TEffectState& effect) 
 {
-	int16_t offset = effect.offset * 2;
-	int16_t magnitude = effect.magnitude;
-	uint16_t elapsedTime = effect.elapsedTime;
-	uint16_t phase = effect.phase;
-	uint16_t period = effect.period;
-	uint16_t periodF = effect.period;
-
-	int16_t maxMagnitude = offset + magnitude;
-	int16_t minMagnitude = offset - magnitude;
-	int32_t phasetime = (phase * period) / 255;
-	uint32_t timeTemp = elapsedTime + phasetime;
-	int32_t reminder = timeTemp % period;
-	int32_t slope = (maxMagnitude - minMagnitude) / periodF;
-	int32_t tempforce = 0;
-	tempforce = slope * reminder;
-	tempforce += minMagnitude;
+	int32_t offset = effect.offset * 2;
+	int32_t magnitude = effect.magnitude;
+	int32_t minMagnitude = offset - magnitude;
+
+	// From min at the start of the period up to max, 0..0x7FFF
+	int32_t ramp = cyclePosition(effect) >> 1;
+	int32_t tempforce = minMagnitude + ((magnitude * 2 * ramp) >> 15);
 	return ApplyEnvelope(effect, tempforce);
 }
 
@@ -747,7 +1069,7 @@ int32_t Joystick_::ConditionForceCalculator(volatile TEffectState& effect, float
 		tempForce = (tempForce > positiveSaturation ? positiveSaturation : tempForce);
 	}
 	else return 0;
-	tempForce = -tempForce * effect.gain / 255;
+	tempForce = -tempForce;
 	switch (effect.effectType) {
 	case  USB_EFFECT_DAMPER:
 		//tempForce = damperFilter.filterIn(tempForce);
@@ -768,34 +1090,33 @@ float Joystick_::NormalizeRange(int32_t x, int32_t maxValue) {
 	return (float)x * 1.00 / maxValue;
 }
 
-int32_t  Joystick_::ApplyGain(int16_t value, uint8_t gain)
-{
-	int32_t value_32 = value;
-	return ((value_32 * gain) / 255);
-}
-
 int32_t Joystick_::ApplyEnvelope(volatile TEffectState& effect, int32_t value)
 {
-	int32_t magnitude = ApplyGain(effect.magnitude, effect.gain);
-	int32_t attackLevel = ApplyGain(effect.attackLevel, effect.gain);
-	int32_t fadeLevel = ApplyGain(effect.fadeLevel, effect.gain);
+	// effect.gain is part of axisGain, applied after the envelope
+	int32_t magnitude = effect.magnitude;
+	int32_t attackLevel = effect.attackLevel;
+	int32_t fadeLevel = effect.fadeLevel;
 	int32_t newValue = magnitude;
 	int32_t attackTime = effect.attackTime;
 	int32_t fadeTime = effect.fadeTime;
-	int32_t elapsedTime = effect.elapsedTime;
+	unsigned long elapsedTime = effect.elapsedTime;
 	int32_t duration = effect.duration;
 
-	if (elapsedTime < attackTime)
+	if (elapsedTime < (unsigned long)attackTime)
 	{
-		newValue = (magnitude - attackLevel) * elapsedTime / attackTime;
+		newValue = (magnitude - attackLevel) * (int32_t)elapsedTime / attackTime;
 		newValue += attackLevel;
 	}
-	if (elapsedTime > (duration - fadeTime))
+	// An infinite effect never fades. A finite one stops once elapsedTime
+	// passes duration, so here elapsedTime fits the int32_t math.
+	if (duration != USB_DURATION_INFINITE && (int32_t)elapsedTime > (duration - fadeTime))
 	{
-		newValue = (magnitude - fadeLevel) * (duration - elapsedTime);
+		newValue = (magnitude - fadeLevel) * (duration - (int32_t)elapsedTime);
 		newValue /= fadeTime;
 		newValue += fadeLevel;
 	}
+	if (magnitude == 0)
+		return value;
 	newValue = newValue * value / magnitude;
 	return newValue;
 }
@@ -823,7 +1144,7 @@ void Joystick_::pressButton(uint8_t button)
     int bit = button % 8;
 
 	bitSet(_buttonValues[index], bit);
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::releaseButton(uint8_t button)
 {
@@ -833,65 +1154,65 @@ void Joystick_::releaseButton(uint8_t button)
     int bit = button % 8;
 
     bitClear(_buttonValues[index], bit);
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 
 void Joystick_::setXAxis(int16_t value)
 {
 	_xAxis = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setYAxis(int16_t value)
 {
 	_yAxis = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setZAxis(int16_t value)
 {
 	_zAxis = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 
 void Joystick_::setRxAxis(int16_t value)
 {
 	_xAxisRotation = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setRyAxis(int16_t value)
 {
 	_yAxisRotation = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setRzAxis(int16_t value)
 {
 	_zAxisRotation = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 
 void Joystick_::setRudder(int16_t value)
 {
 	_rudder = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setThrottle(int16_t value)
 {
 	_throttle = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setAccelerator(int16_t value)
 {
 	_accelerator = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setBrake(int16_t value)
 {
 	_brake = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 void Joystick_::setSteering(int16_t value)
 {
 	_steering = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 
 void Joystick_::setHatSwitch(int8_t hatSwitchIndex, int16_t value)
@@ -899,14 +1220,52 @@ void Joystick_::setHatSwitch(int8_t hatSwitchIndex, int16_t value)
 	if (hatSwitchIndex >= _hatSwitchCount) return;
 	
 	_hatSwitchValues[hatSwitchIndex] = value;
-	if (_autoSendState) sendState();
+	stateChanged();
 }
 
-int Joystick_::buildAndSet16BitValue(bool includeValue, int16_t value, int16_t valueMinimum, int16_t valueMaximum, int16_t actualMinimum, int16_t actualMaximum, uint8_t dataLocation[]) 
+void Joystick_::setAxes(const JoystickAxes& axes)
+{
+	_xAxis = axes.x;
+	_yAxis = axes.y;
+	_zAxis = axes.z;
+	_xAxisRotation = axes.rx;
+	_yAxisRotation = axes.ry;
+	_zAxisRotation = axes.rz;
+	stateChanged();
+}
+
+void Joystick_::setButtons(const uint8_t* buttons, uint8_t count)
+{
+	if (count > _buttonCount) count = _buttonCount;
+
+	uint8_t bytes = count / 8;
+	memcpy(_buttonValues, buttons, bytes);
+	uint8_t rest = count % 8;
+	if (rest)
+	{
+		uint8_t mask = (1 << rest) - 1;
+		_buttonValues[bytes] = (_buttonValues[bytes] & ~mask) | (buttons[bytes] & mask);
+	}
+	stateChanged();
+}
+
+void Joystick_::setButtons(uint32_t buttons)
+{
+	uint8_t values[4] = { (uint8_t)buttons, (uint8_t)(buttons >> 8), (uint8_t)(buttons >> 16), (uint8_t)(buttons >> 24) };
+	setButtons(values, 32);
+}
+
+void Joystick_::setHatSwitches(const int16_t* values)
+{
+	for (uint8_t hatSwitchIndex = 0; hatSwitchIndex < _hatSwitchCount; hatSwitchIndex++)
+	{
+		_hatSwitchValues[hatSwitchIndex] = values[hatSwitchIndex];
+	}
+	stateChanged();
+}
+
+int Joystick_::buildAndSetPackedValue(bool includeValue, int16_t value, int16_t valueMinimum, int16_t valueMaximum, uint8_t bits, uint8_t data[], uint16_t& bitIndex) 
 {
-	int16_t convertedValue;
-	uint8_t highByte;
-	uint8_t lowByte;
 	int16_t realMinimum = min(valueMinimum, valueMaximum);
 	int16_t realMaximum = max(valueMinimum, valueMaximum);
 
@@ -924,30 +1283,36 @@ int Joystick_::buildAndSet16BitValue(bool includeValue, int16_t value, int16_t v
 		value = realMaximum - value + realMinimum;
 	}
 
-	convertedValue = map(value, realMinimum, realMaximum, actualMinimum, actualMaximum);
-
-	highByte = (uint8_t)(convertedValue >> 8);
-	lowByte = (uint8_t)(convertedValue & 0x00FF);
-	
-	dataLocation[0] = lowByte;
-	dataLocation[1] = highByte;
+	bits = fieldBits(bits);
+	int32_t limit = (1L << (bits - 1)) - 1;
+	int32_t convertedValue = map(value, realMinimum, realMaximum, -limit, limit);
+
+	// LSB first from bitIndex on, the other bits of the bytes are kept.
+	// The control endpoint may read the report from the USB interrupt, so
+	// all bytes of the value are stored with interrupts off.
+	uint8_t shift = bitIndex % 8;
+	uint32_t mask = ((1UL << bits) - 1) << shift;
+	uint32_t field = ((uint32_t)convertedValue << shift) & mask;
+	uint8_t* location = &data[bitIndex / 8];
+	noInterrupts();
+	location[0] = (location[0] & ~(uint8_t)mask) | (uint8_t)field;
+	if (shift + bits > 8) {
+		location[1] = (location[1] & ~(uint8_t)(mask >> 8)) | (uint8_t)(field >> 8);
+	}
+	if (shift + bits > 16) {
+		location[2] = (location[2] & ~(uint8_t)(mask >> 16)) | (uint8_t)(field >> 16);
+	}
+	interrupts();
+	bitIndex += bits;
 	
-	return 2;
-}
-
-int Joystick_::buildAndSetAxisValue(bool includeAxis, int16_t axisValue, int16_t axisMinimum, int16_t axisMaximum, uint8_t dataLocation[]) 
-{
-	return buildAndSet16BitValue(includeAxis, axisValue, axisMinimum, axisMaximum, JOYSTICK_AXIS_MINIMUM, JOYSTICK_AXIS_MAXIMUM, dataLocation);
-}
-
-int Joystick_::buildAndSetSimulationValue(bool includeValue, int16_t value, int16_t valueMinimum, int16_t valueMaximum, uint8_t dataLocation[]) 
-{
-	return buildAndSet16BitValue(includeValue, value, valueMinimum, valueMaximum, JOYSTICK_SIMULATOR_MINIMUM, JOYSTICK_SIMULATOR_MAXIMUM, dataLocation);
+	return bits;
 }
 
 void Joystick_::sendState()
 {
-	uint8_t data[_hidReportSize];
+	FFB_PROFILE_BEGIN(start);
+	// Built in place in the cached report, a byte or a value at a time
+	uint8_t* data = _hidReport + 1;
 	int index = 0;
 	
 	// Load Button State
@@ -978,22 +1343,30 @@ void Joystick_::sendState()
 	
 	} // Hat Switches
 
-	// Set Axis Values
-	index += buildAndSetAxisValue(_includeAxisFlags & JOYSTICK_INCLUDE_X_AXIS, _xAxis, _xAxisMinimum, _xAxisMaximum, &(data[index]));
-	index += buildAndSetAxisValue(_includeAxisFlags & JOYSTICK_INCLUDE_Y_AXIS, _yAxis, _yAxisMinimum, _yAxisMaximum, &(data[index]));
-	index += buildAndSetAxisValue(_includeAxisFlags & JOYSTICK_INCLUDE_Z_AXIS, _zAxis, _zAxisMinimum, _zAxisMaximum, &(data[index]));
-	index += buildAndSetAxisValue(_includeAxisFlags & JOYSTICK_INCLUDE_RX_AXIS, _xAxisRotation, _rxAxisMinimum, _rxAxisMaximum, &(data[index]));
-	index += buildAndSetAxisValue(_includeAxisFlags & JOYSTICK_INCLUDE_RY_AXIS, _yAxisRotation, _ryAxisMinimum, _ryAxisMaximum, &(data[index]));
-	index += buildAndSetAxisValue(_includeAxisFlags & JOYSTICK_INCLUDE_RZ_AXIS, _zAxisRotation, _rzAxisMinimum, _rzAxisMaximum, &(data[index]));
-	
-	// Set Simulation Values
-	index += buildAndSetSimulationValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_RUDDER, _rudder, _rudderMinimum, _rudderMaximum, &(data[index]));
-	index += buildAndSetSimulationValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_THROTTLE, _throttle, _throttleMinimum, _throttleMaximum, &(data[index]));
-	index += buildAndSetSimulationValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_ACCELERATOR, _accelerator, _acceleratorMinimum, _acceleratorMaximum, &(data[index]));
-	index += buildAndSetSimulationValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_BRAKE, _brake, _brakeMinimum, _brakeMaximum, &(data[index]));
-	index += buildAndSetSimulationValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_STEERING, _steering, _steeringMinimum, _steeringMaximum, &(data[index]));
-
-	DynamicHID().SendReport(_hidReportId, data, _hidReportSize);
+	// Set Axis and Simulation Values, packed at their bit depths
+	uint16_t bitIndex = index * 8;
+	buildAndSetPackedValue(_includeAxisFlags & JOYSTICK_INCLUDE_X_AXIS, _xAxis, _xAxisMinimum, _xAxisMaximum, _bitDepths.x, data, bitIndex);
+	buildAndSetPackedValue(_includeAxisFlags & JOYSTICK_INCLUDE_Y_AXIS, _yAxis, _yAxisMinimum, _yAxisMaximum, _bitDepths.y, data, bitIndex);
+	buildAndSetPackedValue(_includeAxisFlags & JOYSTICK_INCLUDE_Z_AXIS, _zAxis, _zAxisMinimum, _zAxisMaximum, _bitDepths.z, data, bitIndex);
+	buildAndSetPackedValue(_includeAxisFlags & JOYSTICK_INCLUDE_RX_AXIS, _xAxisRotation, _rxAxisMinimum, _rxAxisMaximum, _bitDepths.rx, data, bitIndex);
+	buildAndSetPackedValue(_includeAxisFlags & JOYSTICK_INCLUDE_RY_AXIS, _yAxisRotation, _ryAxisMinimum, _ryAxisMaximum, _bitDepths.ry, data, bitIndex);
+	buildAndSetPackedValue(_includeAxisFlags & JOYSTICK_INCLUDE_RZ_AXIS, _zAxisRotation, _rzAxisMinimum, _rzAxisMaximum, _bitDepths.rz, data, bitIndex);
+	buildAndSetPackedValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_RUDDER, _rudder, _rudderMinimum, _rudderMaximum, _bitDepths.rudder, data, bitIndex);
+	buildAndSetPackedValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_THROTTLE, _throttle, _throttleMinimum, _throttleMaximum, _bitDepths.throttle, data, bitIndex);
+	buildAndSetPackedValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_ACCELERATOR, _accelerator, _acceleratorMinimum, _acceleratorMaximum, _bitDepths.accelerator, data, bitIndex);
+	buildAndSetPackedValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_BRAKE, _brake, _brakeMinimum, _brakeMaximum, _bitDepths.brake, data, bitIndex);
+	buildAndSetPackedValue(_includeSimulatorFlags & JOYSTICK_INCLUDE_STEERING, _steering, _steeringMinimum, _steeringMaximum, _bitDepths.steering, data, bitIndex);
+
+	DynamicHID().SendReport(_hidNode);
+	// Repeats of the other joysticks are due as well
+	DynamicHID().SendIdleReports();
+	FFB_PROFILE_END(FFB_STAGE_INPUT_SEND, start);
+}
+
+void Joystick_::stateChanged()
+{
+	if (_autoSendState) sendState();
+	else DynamicHID().SendIdleReports();
 }
 
 #endif
@@ -55,9 +55,27 @@
 #define JOYSTICK_TYPE_GAMEPAD              0x05
 #define JOYSTICK_TYPE_MULTI_AXIS           0x08
 
-#define DIRECTION_ENABLE                   0x04
-#define X_AXIS_ENABLE                      0x01
-#define Y_AXIS_ENABLE                      0x02
+// Largest report descriptor the constructor builds, every value in a run of its own
+#define JOYSTICK_DESCRIPTOR_BUFFER_SIZE     250
+
+// RAM budgets in bytes, checked when the library is compiled, 0 = no check.
+// Set them as build flags, e.g. -DFFB_RAM_BUDGET=1200.
+// JOYSTICK_RAM_BUDGET: one Joystick_ object
+// FFB_RAM_BUDGET: the force feedback state of one joystick (PIDReportHandler)
+// JOYSTICK_SHARED_RAM_BUDGET: static buffers shared by all joysticks
+#ifndef JOYSTICK_RAM_BUDGET
+#define JOYSTICK_RAM_BUDGET 0
+#endif
+#ifndef FFB_RAM_BUDGET
+#define FFB_RAM_BUDGET 0
+#endif
+#ifndef JOYSTICK_SHARED_RAM_BUDGET
+#define JOYSTICK_SHARED_RAM_BUDGET 0
+#endif
+
+// includeForceFeedback default: only the first joystick created gets force feedback
+#define JOYSTICK_FFB_FIRST_ONLY               2
+
 #define FORCE_FEEDBACK_MAXGAIN              100
 #define DEG_TO_RAD              ((float)((float)3.14159265359 / 180.0))
 
@@ -77,6 +95,41 @@ struct Gains{
 	uint8_t customGain        = FORCE_FEEDBACK_MAXGAIN;
 };
 
+//RAM of one joystick in bytes, see getMemoryUsage()
+struct JoystickMemoryUsage{
+    uint16_t joystick = 0;      //the Joystick_ object
+    uint16_t pidHandler = 0;    //force feedback state on the heap, 0 without force feedback
+    uint16_t effectStates = 0;  //effect table, part of pidHandler
+    uint16_t descriptor = 0;    //report descriptor copy on the heap
+    uint16_t reports = 0;       //button values, input report cache and HID node on the heap
+    uint16_t shared = 0;        //static buffers shared by all joysticks
+};
+
+//axis values for setAxes
+struct JoystickAxes{
+    int16_t x = 0;
+    int16_t y = 0;
+    int16_t z = 0;
+    int16_t rx = 0;
+    int16_t ry = 0;
+    int16_t rz = 0;
+};
+
+//report field size in bits of each axis, 8 to 16, e.g. 10 for a 10 bit ADC
+struct JoystickBitDepths{
+    uint8_t x = 16;
+    uint8_t y = 16;
+    uint8_t z = 16;
+    uint8_t rx = 16;
+    uint8_t ry = 16;
+    uint8_t rz = 16;
+    uint8_t rudder = 16;
+    uint8_t throttle = 16;
+    uint8_t accelerator = 16;
+    uint8_t brake = 16;
+    uint8_t steering = 16;
+};
+
 struct EffectParams{
     int32_t springMaxPosition = 0;
     int32_t springPosition = 0;
@@ -93,6 +146,11 @@ struct EffectParams{
 
 class Joystick_
 {
+	// scans straight into _buttonValues
+	friend class ButtonMatrix;
+	// samples straight into the axis fields
+	friend class AxisSampler;
+
 private:
 
     // Joystick State
@@ -140,19 +198,41 @@ private:
 	int16_t                  _steeringMinimum = JOYSTICK_DEFAULT_SIMULATOR_MINIMUM;
 	int16_t                  _steeringMaximum = JOYSTICK_DEFAULT_SIMULATOR_MAXIMUM;
 
+	JoystickBitDepths        _bitDepths;
+
 	uint8_t                  _hidReportId;
 	uint8_t                  _hidReportSize; 
+	// Last packed input report, report ID first, shared with the HID node
+	uint8_t                 *_hidReport = NULL;
+	DynamicHIDSubDescriptor *_hidNode = NULL;
+	// Joystick created before this one, see the constructor
+	Joystick_               *_previousJoystick = NULL;
 
-	//force feedback gain
+	//force feedback gain, one per force feedback axis
 	Gains* m_gains;
 
-	//force feedback effect params
+	//force feedback effect params, one per force feedback axis
 	EffectParams* m_effect_params;
+	//params seen by the last forceCalculator, to spot moved condition metrics
+	EffectParams m_last_effect_params[MAX_FFB_AXIS_COUNT];
+
+	//force feedback effect state, NULL if force feedback is not included
+	PIDReportHandler* m_pid_report_handler = NULL;
+	//clock() sampled once per forceCalculator run
+	unsigned long m_frame_time = 0;
+
+#if FFB_TELEMETRY
+	//telemetry frame, rebuilt in place every m_telemetry_decimation force calculations
+	FFBTelemetry_Input_Data_t m_telemetry = {};
+	uint8_t m_telemetry_decimation = 0;
+	uint8_t m_telemetry_countdown = 0;
+	unsigned long m_telemetry_last_start = 0;
+	void sendTelemetry(const int32_t* forces, unsigned long start);
+#endif
 
 	///force calculate funtion
 	float NormalizeRange(int32_t x, int32_t maxValue);
 	int32_t ApplyEnvelope(volatile TEffectState& effect, int32_t value);
-	int32_t ApplyGain(int16_t value, uint8_t gain);
 	int32_t ConstantForceCalculator(volatile TEffectState& effect);
 	int32_t RampForceCalculator(volatile TEffectState& effect);
 	int32_t SquareForceCalculator(volatile TEffectState& effect);
@@ -162,11 +242,24 @@ private:
 	int32_t SawtoothUpForceCalculator(volatile TEffectState& effect);
 	int32_t ConditionForceCalculator(volatile TEffectState& effect, float metric, uint8_t axis);
 	void forceCalculator(int32_t* forces);
-	int32_t getEffectForce(volatile TEffectState& effect, Gains _gains, EffectParams _effect_params, uint8_t axis);
+	void sendPIDState();
+	void getEffectForce(volatile TEffectState& effect, int32_t* forces);
+	//force routines, one per effect type, indexed by TEffectState.forceRoutine
+	typedef void (Joystick_::*EffectForceRoutine)(volatile TEffectState& effect, int32_t* forces);
+	static const EffectForceRoutine effectForceRoutines[USB_EFFECT_FRICTION + 1];
+	void noForce(volatile TEffectState&, int32_t*) {}
+	template <int32_t (Joystick_::*calculator)(volatile TEffectState&)>
+	void directedForce(volatile TEffectState& effect, int32_t* forces);
+	template <uint8_t effectType>
+	void conditionForce(volatile TEffectState& effect, int32_t* forces);
+	void updateEffectGain(volatile TEffectState& effect);
+	uint8_t changedConditionMetrics();
+	// Frees the PID handler and takes the PID reports out of the HID descriptor
+	void dropForceFeedback();
 protected:
-	int buildAndSet16BitValue(bool includeValue, int16_t value, int16_t valueMinimum, int16_t valueMaximum, int16_t actualMinimum, int16_t actualMaximum, uint8_t dataLocation[]);
-	int buildAndSetAxisValue(bool includeAxis, int16_t axisValue, int16_t axisMinimum, int16_t axisMaximum, uint8_t dataLocation[]);
-	int buildAndSetSimulationValue(bool includeValue, int16_t value, int16_t valueMinimum, int16_t valueMaximum, uint8_t dataLocation[]);
+	int buildAndSetPackedValue(bool includeValue, int16_t value, int16_t valueMinimum, int16_t valueMaximum, uint8_t bits, uint8_t data[], uint16_t& bitIndex);
+	// Sends the report when auto sending, otherwise only the idle repeats that are due
+	void stateChanged();
 
 public:
 	Joystick_(
@@ -184,7 +277,9 @@ public:
 		bool includeThrottle = true,
 		bool includeAccelerator = true,
 		bool includeBrake = true,
-		bool includeSteering = true);
+		bool includeSteering = true,
+		uint8_t includeForceFeedback = JOYSTICK_FFB_FIRST_ONLY,
+		const JoystickBitDepths& bitDepths = JoystickBitDepths());
 
 	void begin(bool initAutoSendState = true);
 	void end();
@@ -268,20 +363,57 @@ public:
 	void releaseButton(uint8_t button);
 	void setHatSwitch(int8_t hatSwitch, int16_t value);
 
+	// Bulk setters, each sends at most one report
+	void setAxes(const JoystickAxes& axes);
+	// bit n of buttons[n / 8] is button n, for the first count buttons
+	void setButtons(const uint8_t* buttons, uint8_t count);
+	// bit n is button n, for buttons 0..31
+	void setButtons(uint32_t buttons);
+	// one value per hat switch
+	void setHatSwitches(const int16_t* values);
+
 	void sendState();
 
 	//force feedback Interfaces
+	//forces must hold MAX_FFB_AXIS_COUNT values
 	void getForce(int32_t* forces);
-	//set gain functions
+	//set gain functions, _gains must hold MAX_FFB_AXIS_COUNT entries
+	//call it again after changing the gains, they are folded into each effect's gain
 	int8_t setGains(Gains* _gains){
 	    if(_gains != nullptr){
 			//it should be added some limition here,but im so tired,it's 2:24 A.M now!
 	        m_gains = _gains;
+	        if (m_pid_report_handler != NULL)
+	            m_pid_report_handler->effectGainsDirty = 0xFFFF;
 	        return 0;
 	    }
 	    return -1;
 	};
-	//set effect params funtions
+	//set the ms time source of force feedback effects, e.g. a virtual clock for replays
+	//it is read once per getForce(), so all effects of a tick share one time
+	int8_t setClock(unsigned long (*_clock)(void)){
+	    if(_clock != nullptr && m_pid_report_handler != NULL){
+	        m_pid_report_handler->clock = _clock;
+	        return 0;
+	    }
+	    return -1;
+	};
+#if FFB_TELEMETRY
+	//send a telemetry frame every decimation getForce() calls, 0 (the default) stops them
+	void setTelemetryDecimation(uint8_t decimation){
+	    m_telemetry_decimation = decimation;
+	    m_telemetry_countdown = 0;
+	};
+#endif
+	//RAM this joystick uses, for this configuration
+	void getMemoryUsage(JoystickMemoryUsage& usage);
+#if FFB_PROFILE
+	//pipeline timing, stage is one of the FFB_STAGE_* values in FFBProfile.h,
+	//shared by all joysticks. All zero for any other stage.
+	const FFBStageStats& getProfile(uint8_t stage){ return ffbProfileStage(stage); };
+	void resetProfile(){ ffbProfileReset(); };
+#endif
+	//set effect params funtions, _effect_params must hold MAX_FFB_AXIS_COUNT entries
 	int8_t setEffectParams(EffectParams* _effect_params){
 	    if(_effect_params != nullptr){
 	        m_effect_params = _effect_params;